@@ -1,5 +1,40 @@
+use std::env;
+use std::fs;
+use std::path::PathBuf;
+use std::process::Stdio;
+
+/// Compiles and links a small program against the OpenMP runtime, so that OpenMP is only enabled
+/// where the toolchain really provides it rather than where the platform usually does.
+fn openmp_links(
+    compiler: &cc::Tool,
+    openmp_runtime: &str,
+) -> bool {
+    let out_dir = match env::var_os("OUT_DIR") {
+        Some(out_dir) => PathBuf::from(out_dir),
+        None => return false,
+    };
+    let probe_source = out_dir.join("openmp_probe.c");
+    let probe_binary = out_dir.join("openmp_probe");
+    let probe = "#include <omp.h>\nint main(void) { return omp_get_max_threads() > 0 ? 0 : 1; }\n";
+    if fs::write(&probe_source, probe).is_err() {
+        return false;
+    }
+
+    compiler.to_command()
+        .arg("-fopenmp")
+        .arg(&probe_source)
+        .arg("-o")
+        .arg(&probe_binary)
+        .arg(format!("-l{}", openmp_runtime))
+        .stdout(Stdio::null())
+        .stderr(Stdio::null())
+        .status()
+        .is_ok_and(|status| status.success())
+}
+
 fn main() {
     println!("cargo:rerun-if-changed=libsais.c");
+    println!("cargo:rustc-check-cfg=cfg(libsais_openmp)");
 
     let src = [
         "src/libsais/libsais.c",
@@ -7,5 +42,35 @@ fn main() {
     let mut builder = cc::Build::new();
     let build = builder
         .files(src.iter());
+
+    // libsais only compiles its multi-threaded entry points when _OPENMP is defined.
+    // GCC and clang toolchains get OpenMP only when a program built with -fopenmp links
+    // against their runtime, so e.g. Apple clang or a clang without libomp installed
+    // keep the single-threaded build and the Writer ignores its threads argument there.
+    let compiler = build.get_compiler();
+    let openmp_runtime = if compiler.is_like_msvc() {
+        build.flag("/openmp");
+        Some("")
+    } else {
+        let openmp_runtime = if compiler.is_like_gnu() {
+            "gomp"
+        } else {
+            "omp"
+        };
+        if build.is_flag_supported("-fopenmp").unwrap_or(false) && openmp_links(&compiler, openmp_runtime) {
+            build.flag("-fopenmp");
+            Some(openmp_runtime)
+        } else {
+            None
+        }
+    };
+
     build.compile("libsais");
+
+    if let Some(openmp_runtime) = openmp_runtime {
+        if !openmp_runtime.is_empty() {
+            println!("cargo:rustc-link-lib={}", openmp_runtime);
+        }
+        println!("cargo:rustc-cfg=libsais_openmp");
+    }
 }
@@ -8,10 +8,18 @@ class Writer:
         self,
         index_file_path: str,
         max_chunk_len: typing.Optional[int] = None,
+        threads: typing.Optional[int] = None,
+        concurrent_chunks: typing.Optional[int] = None,
+        inline_prefixes: typing.Optional[bool] = None,
+        lcp_bounds: typing.Optional[bool] = None,
     ) -> None:
         self.writer = pysubstringsearch.Writer(
             index_file_path=index_file_path,
             max_chunk_len=max_chunk_len,
+            threads=threads,
+            concurrent_chunks=concurrent_chunks,
+            inline_prefixes=inline_prefixes,
+            lcp_bounds=lcp_bounds,
         )
 
     def add_entries_from_file_lines(
@@ -41,33 +49,142 @@ class Writer:
         self.writer.finalize()
 
 
+class ResultSet:
+    def __init__(
+        self,
+        result_set: pysubstringsearch.ResultSet,
+    ) -> None:
+        self.result_set = result_set
+
+    def __len__(
+        self,
+    ) -> int:
+        return len(self.result_set)
+
+    def __getitem__(
+        self,
+        index: int,
+    ) -> str:
+        return self.result_set[index]
+
+    def __iter__(
+        self,
+    ) -> typing.Iterator[str]:
+        for index in range(len(self.result_set)):
+            yield self.result_set[index]
+
+    def bytes(
+        self,
+        index: int,
+    ) -> bytes:
+        return self.result_set.bytes(
+            index=index,
+        )
+
+    def memoryview(
+        self,
+        index: int,
+    ) -> memoryview:
+        return self.result_set.memoryview(
+            index=index,
+        )
+
+
 class Reader:
     def __init__(
         self,
         index_file_path: str,
+        in_memory: typing.Optional[bool] = None,
+        max_resident_bytes: typing.Optional[int] = None,
+        block_cache_bytes: typing.Optional[int] = None,
     ) -> None:
         self.reader = pysubstringsearch.Reader(
             index_file_path=index_file_path,
+            in_memory=in_memory,
+            max_resident_bytes=max_resident_bytes,
+            block_cache_bytes=block_cache_bytes,
         )
 
     def search(
         self,
         substring: str,
+        limit: typing.Optional[int] = None,
     ) -> typing.List[str]:
         return self.reader.search(
             substring=substring,
+            limit=limit,
+        )
+
+    def search_lazy(
+        self,
+        substring: str,
+        limit: typing.Optional[int] = None,
+    ) -> ResultSet:
+        return ResultSet(
+            result_set=self.reader.search_lazy(
+                substring=substring,
+                limit=limit,
+            ),
         )
 
     def search_multiple(
         self,
         substrings: typing.List[str],
     ) -> typing.List[str]:
-        results = []
-        for substring in substrings:
-            results.extend(
-                self.search(
-                    substring=substring,
-                ),
-            )
-
-        return results
+        results = self.reader.search_multiple(
+            substrings=substrings,
+        )
+
+        return [
+            result
+            for substring_results in results
+            for result in substring_results
+        ]
+
+    def iter_search(
+        self,
+        substring: str,
+    ) -> typing.Iterator[str]:
+        return self.reader.iter_search(
+            substring=substring,
+        )
+
+    def search_positions(
+        self,
+        substring: str,
+    ) -> typing.List[typing.Tuple[int, int, int, typing.List[int]]]:
+        return self.reader.search_positions(
+            substring=substring,
+        )
+
+    def search_multiple_grouped(
+        self,
+        substrings: typing.List[str],
+    ) -> typing.List[typing.List[str]]:
+        return self.reader.search_multiple(
+            substrings=substrings,
+        )
+
+    def count_occurrences(
+        self,
+        substring: str,
+    ) -> int:
+        return self.reader.count_occurrences(
+            substring=substring,
+        )
+
+    def count_lines(
+        self,
+        substring: str,
+    ) -> int:
+        return self.reader.count_lines(
+            substring=substring,
+        )
+
+    def count_multiple(
+        self,
+        substrings: typing.List[str],
+    ) -> typing.List[int]:
+        return self.reader.count_multiple(
+            substrings=substrings,
+        )
@@ -6,6 +6,10 @@ class Writer:
         self,
         index_file_path: str,
         max_chunk_len: typing.Optional[int] = None,
+        threads: typing.Optional[int] = None,
+        concurrent_chunks: typing.Optional[int] = None,
+        inline_prefixes: typing.Optional[bool] = None,
+        lcp_bounds: typing.Optional[bool] = None,
     ) -> None: ...
 
     def add_entries_from_file_lines(
@@ -27,18 +31,74 @@ class Writer:
     ) -> None: ...
 
 
+class ResultSet:
+    def __len__(
+        self,
+    ) -> int: ...
+
+    def __getitem__(
+        self,
+        index: int,
+    ) -> str: ...
+
+    def bytes(
+        self,
+        index: int,
+    ) -> bytes: ...
+
+    def memoryview(
+        self,
+        index: int,
+    ) -> memoryview: ...
+
+
 class Reader:
     def __init__(
         self,
         index_file_path: str,
+        in_memory: typing.Optional[bool] = None,
+        max_resident_bytes: typing.Optional[int] = None,
+        block_cache_bytes: typing.Optional[int] = None,
     ) -> None: ...
 
     def search(
         self,
         substring: str,
+        limit: typing.Optional[int] = None,
     ) -> typing.List[str]: ...
 
+    def search_lazy(
+        self,
+        substring: str,
+        limit: typing.Optional[int] = None,
+    ) -> ResultSet: ...
+
     def search_multiple(
         self,
         substrings: typing.List[str],
-    ) -> typing.List[str]: ...
+    ) -> typing.List[typing.List[str]]: ...
+
+    def iter_search(
+        self,
+        substring: str,
+    ) -> typing.Iterator[str]: ...
+
+    def search_positions(
+        self,
+        substring: str,
+    ) -> typing.List[typing.Tuple[int, int, int, typing.List[int]]]: ...
+
+    def count_occurrences(
+        self,
+        substring: str,
+    ) -> int: ...
+
+    def count_lines(
+        self,
+        substring: str,
+    ) -> int: ...
+
+    def count_multiple(
+        self,
+        substrings: typing.List[str],
+    ) -> typing.List[int]: ...
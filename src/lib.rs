@@ -1,18 +1,41 @@
-use ahash::AHashSet;
+use ahash::{AHashMap, AHashSet};
 use bstr::io::BufReadExt;
-use byteorder::{ReadBytesExt, WriteBytesExt, ByteOrder, LittleEndian};
-use memchr::memmem;
-use parking_lot::Mutex;
+use byteorder::{WriteBytesExt, ByteOrder, LittleEndian};
+use memmap2::Mmap;
+use parking_lot::{Condvar, Mutex};
 use pyo3::exceptions;
+use pyo3::ffi;
 use pyo3::prelude::*;
+use pyo3::types::PyBytes;
+use pyo3::AsPyPointer;
 use rayon::prelude::*;
+use std::borrow::Cow;
+use std::cmp::Ordering;
+use std::ffi::c_void;
+use std::os::raw::c_int;
 use std::fs::File;
-use std::io::{BufReader, BufWriter, Read, Seek, SeekFrom, Write};
+use std::io::{self, BufReader, BufWriter, Write};
+use std::ops::Range;
 use std::str;
-use std::sync::Arc;
+use std::sync::{Arc, OnceLock};
+use std::sync::atomic::{AtomicUsize, Ordering as AtomicOrdering};
+use std::sync::mpsc::{self, Receiver, Sender};
+use std::thread::{self, JoinHandle};
 
 extern "C" {
-    pub fn libsais(
+    pub fn libsais_create_ctx() -> *mut c_void;
+
+    #[cfg(libsais_openmp)]
+    pub fn libsais_create_ctx_omp(
+        threads: i32,
+    ) -> *mut c_void;
+
+    pub fn libsais_free_ctx(
+        ctx: *mut c_void,
+    );
+
+    pub fn libsais_ctx(
+        ctx: *const c_void,
         data: *const u8,
         suffix_array: *mut i32,
         data_len: i32,
@@ -21,28 +44,734 @@ extern "C" {
     ) -> i32;
 }
 
-fn construct_suffix_array(
+const INDEX_FILE_MAGIC: &[u8; 4] = b"PSSI";
+const INDEX_FILE_VERSION: u32 = 4;
+const INDEX_FILE_HEADER_LEN: usize = 8;
+const INDEX_FILE_TRAILER_LEN: usize = 24;
+const CHUNKS_TABLE_ENTRY_FIELDS: usize = 17;
+const SUFFIX_SAMPLES_RATE: usize = 64;
+const QGRAM_BOUNDS_COUNT: usize = 256 * 256 + 1;
+const QGRAM_TABLE_MIN_CHUNK_LEN: usize = 1024 * 1024;
+const SUFFIX_PREFIX_LEN: usize = 4;
+const LCP_ESCAPE: u8 = u8::MAX;
+const LINE_RANKS_INTERVAL: usize = 64 * 1024;
+const MAX_CHUNK_LEN: usize = i32::MAX as usize;
+const LOAD_BLOCK_LEN: usize = 16 * 1024 * 1024;
+const CACHE_BLOCK_LEN: usize = 4 * 1024;
+const BLOCK_CACHE_SHARDS: usize = 16;
+const LINES_BATCH_LEN: usize = 1024;
+
+#[cfg(not(libsais_openmp))]
+unsafe fn libsais_create_ctx_omp(
+    _threads: i32,
+) -> *mut c_void {
+    libsais_create_ctx()
+}
+
+/// Holds a libsais context and the suffix array buffer across chunks, so constructing hundreds of
+/// chunks does not allocate libsais' internal state or a chunk sized array for each one of them.
+struct SuffixArrayBuilder {
+    context: *mut c_void,
+    suffix_array: Vec<i32>,
+}
+
+impl SuffixArrayBuilder {
+    fn new(
+        threads: i32,
+    ) -> Self {
+        SuffixArrayBuilder {
+            context: unsafe { libsais_create_ctx_omp(threads) },
+            suffix_array: Vec::new(),
+        }
+    }
+
+    fn construct(
+        &mut self,
+        buffer: &[u8],
+    ) -> io::Result<&[i32]> {
+        if self.suffix_array.len() < buffer.len() {
+            self.suffix_array.resize(buffer.len(), 0);
+        }
+        let suffix_array = &mut self.suffix_array[..buffer.len()];
+
+        let result = unsafe {
+            libsais_ctx(
+                self.context,
+                buffer.as_ptr(),
+                suffix_array.as_mut_ptr(),
+                buffer.len() as i32,
+                0,
+                std::ptr::null_mut::<i32>(),
+            )
+        };
+        if result != 0 {
+            return Err(io::Error::other("suffix array construction failed"));
+        }
+
+        Ok(suffix_array)
+    }
+}
+
+impl Drop for SuffixArrayBuilder {
+    fn drop(
+        &mut self,
+    ) {
+        unsafe {
+            libsais_free_ctx(self.context);
+        }
+    }
+}
+
+/// The integer types stored as little endian arrays in the index file.
+trait LittleEndianItem: Copy + Default {
+    fn read_into(
+        bytes: &[u8],
+        items: &mut [Self],
+    );
+
+    fn write_into(
+        items: &[Self],
+        bytes: &mut [u8],
+    );
+
+    fn from_little_endian(
+        items: &mut [Self],
+    );
+}
+
+impl LittleEndianItem for u8 {
+    fn read_into(
+        bytes: &[u8],
+        items: &mut [Self],
+    ) {
+        items.copy_from_slice(bytes);
+    }
+
+    fn write_into(
+        items: &[Self],
+        bytes: &mut [u8],
+    ) {
+        bytes.copy_from_slice(items);
+    }
+
+    fn from_little_endian(
+        _items: &mut [Self],
+    ) {
+    }
+}
+
+impl LittleEndianItem for i32 {
+    fn read_into(
+        bytes: &[u8],
+        items: &mut [Self],
+    ) {
+        LittleEndian::read_i32_into(bytes, items);
+    }
+
+    fn write_into(
+        items: &[Self],
+        bytes: &mut [u8],
+    ) {
+        LittleEndian::write_i32_into(items, bytes);
+    }
+
+    fn from_little_endian(
+        items: &mut [Self],
+    ) {
+        LittleEndian::from_slice_i32(items);
+    }
+}
+
+impl LittleEndianItem for u32 {
+    fn read_into(
+        bytes: &[u8],
+        items: &mut [Self],
+    ) {
+        LittleEndian::read_u32_into(bytes, items);
+    }
+
+    fn write_into(
+        items: &[Self],
+        bytes: &mut [u8],
+    ) {
+        LittleEndian::write_u32_into(items, bytes);
+    }
+
+    fn from_little_endian(
+        items: &mut [Self],
+    ) {
+        LittleEndian::from_slice_u32(items);
+    }
+}
+
+impl LittleEndianItem for u64 {
+    fn read_into(
+        bytes: &[u8],
+        items: &mut [Self],
+    ) {
+        LittleEndian::read_u64_into(bytes, items);
+    }
+
+    fn write_into(
+        items: &[Self],
+        bytes: &mut [u8],
+    ) {
+        LittleEndian::write_u64_into(items, bytes);
+    }
+
+    fn from_little_endian(
+        items: &mut [Self],
+    ) {
+        LittleEndian::from_slice_u64(items);
+    }
+}
+
+/// Writes the values as little endian in one bulk write when the host byte order allows it, which
+/// also lets BufWriter hand large slices straight to the file without copying them.
+fn write_slice<T: LittleEndianItem>(
+    index_file: &mut impl Write,
+    values: &[T],
+) -> io::Result<()> {
+    if cfg!(target_endian = "little") {
+        let bytes = unsafe {
+            std::slice::from_raw_parts(values.as_ptr() as *const u8, std::mem::size_of_val(values))
+        };
+
+        return index_file.write_all(bytes);
+    }
+
+    let item_len = std::mem::size_of::<T>();
+    let mut bytes = [0; 64 * 1024];
+    for values in values.chunks(bytes.len() / item_len) {
+        let bytes = &mut bytes[..std::mem::size_of_val(values)];
+        T::write_into(values, bytes);
+        index_file.write_all(bytes)?;
+    }
+
+    Ok(())
+}
+
+/// Writes every suffix array entry followed by the first bytes of its suffix, so a Reader resolves
+/// most comparisons from the suffix array without reading the text.
+fn write_suffixes_with_prefixes(
+    index_file: &mut impl Write,
+    suffix_array: &[i32],
+    suffix_prefixes: &[u32],
+) -> io::Result<()> {
+    let mut entries = [0_u32; 16 * 1024];
+    for (suffix_array, suffix_prefixes) in suffix_array.chunks(entries.len() / 2).zip(suffix_prefixes.chunks(entries.len() / 2)) {
+        let entries = &mut entries[..suffix_array.len() * 2];
+        for ((entry, &data_index), &suffix_prefix) in entries.chunks_exact_mut(2).zip(suffix_array).zip(suffix_prefixes) {
+            entry[0] = data_index as u32;
+            entry[1] = suffix_prefix;
+        }
+        write_slice(index_file, entries)?;
+    }
+
+    Ok(())
+}
+
+/// The first 8 bytes of the suffix as a big endian integer, zero padded, so keys order the way
+/// their suffixes do as long as they differ.
+fn suffix_key(
+    data: &[u8],
+    data_index: usize,
+) -> u64 {
+    let suffix = &data[data_index..];
+    let mut key = [0; 8];
+    let key_len = suffix.len().min(key.len());
+    key[..key_len].copy_from_slice(&suffix[..key_len]);
+
+    u64::from_be_bytes(key)
+}
+
+/// The number of leading bytes both slices share, compared 8 bytes at a time.
+fn common_prefix_len(
+    first: &[u8],
+    second: &[u8],
+) -> usize {
+    let len = first.len().min(second.len());
+
+    let mut prefix_len = 0;
+    while prefix_len + 8 <= len {
+        let first_word = u64::from_le_bytes(first[prefix_len..prefix_len + 8].try_into().unwrap());
+        let second_word = u64::from_le_bytes(second[prefix_len..prefix_len + 8].try_into().unwrap());
+        if first_word != second_word {
+            return prefix_len + (first_word ^ second_word).trailing_zeros() as usize / 8;
+        }
+        prefix_len += 8;
+    }
+
+    prefix_len + first[prefix_len..len].iter().zip(&second[prefix_len..len]).take_while(|(first, second)| first == second).count()
+}
+
+/// Orders the text by its first substring length bytes, given that the first `skip` of them are
+/// known to match, and returns how many bytes match in total.
+fn compare_prefix(
+    text: &[u8],
+    substring: &[u8],
+    skip: usize,
+) -> (Ordering, usize) {
+    let compared_len = substring.len().min(text.len());
+    let prefix_len = skip + common_prefix_len(&text[skip..compared_len], &substring[skip..compared_len]);
+
+    match prefix_len < compared_len {
+        true => (text[prefix_len].cmp(&substring[prefix_len]), prefix_len),
+        false => (compared_len.cmp(&substring.len()), prefix_len),
+    }
+}
+
+/// Every SUFFIX_SAMPLES_RATE-th suffix of a chunk with its key and rank, laid out in Eytzinger
+/// order so the first levels of every search share a few cache lines.
+struct SuffixSamples {
+    keys: Vec<u64>,
+    ranks: Vec<u32>,
+}
+
+impl SuffixSamples {
+    fn new() -> Self {
+        SuffixSamples {
+            keys: Vec::new(),
+            ranks: Vec::new(),
+        }
+    }
+
+    fn build(
+        &mut self,
+        buffer: &[u8],
+        suffix_array: &[i32],
+    ) {
+        let samples_count = suffix_array.len().div_ceil(SUFFIX_SAMPLES_RATE);
+        self.keys.clear();
+        self.keys.resize(samples_count, 0);
+        self.ranks.clear();
+        self.ranks.resize(samples_count, 0);
+
+        self.fill_subtree(buffer, suffix_array, 1, &mut 0);
+    }
+
+    fn fill_subtree(
+        &mut self,
+        buffer: &[u8],
+        suffix_array: &[i32],
+        node: usize,
+        next_sample: &mut usize,
+    ) {
+        if node > self.keys.len() {
+            return;
+        }
+
+        self.fill_subtree(buffer, suffix_array, 2 * node, next_sample);
+        let rank = *next_sample * SUFFIX_SAMPLES_RATE;
+        self.keys[node - 1] = suffix_key(buffer, suffix_array[rank] as usize);
+        self.ranks[node - 1] = rank as u32;
+        *next_sample += 1;
+        self.fill_subtree(buffer, suffix_array, 2 * node + 1, next_sample);
+    }
+}
+
+/// The rank of the first suffix starting with every 2 byte prefix, or a greater one, so the suffixes
+/// sharing a prefix are found with two lookups. The table is only worth its 256 KB for large
+/// chunks and is left empty for smaller ones.
+struct QgramTable {
+    bounds: Vec<u32>,
+}
+
+impl QgramTable {
+    fn new() -> Self {
+        QgramTable {
+            bounds: Vec::new(),
+        }
+    }
+
+    /// Counts the prefixes with a sequential pass over the text, a suffix of a single byte
+    /// counting as that byte followed by a zero, which is where it sorts.
+    fn build(
+        &mut self,
+        buffer: &[u8],
+    ) {
+        self.bounds.clear();
+        if buffer.len() < QGRAM_TABLE_MIN_CHUNK_LEN {
+            return;
+        }
+
+        self.bounds.resize(QGRAM_BOUNDS_COUNT, 0);
+        for qgram in buffer.windows(2) {
+            self.bounds[((qgram[0] as usize) << 8 | qgram[1] as usize) + 1] += 1;
+        }
+        if let Some(&last_byte) = buffer.last() {
+            self.bounds[((last_byte as usize) << 8) + 1] += 1;
+        }
+
+        let mut bound = 0;
+        for qgram_bound in self.bounds.iter_mut() {
+            bound += *qgram_bound;
+            *qgram_bound = bound;
+        }
+    }
+}
+
+/// The longest common prefixes a Manber-Myers binary search needs: every suffix is the middle of
+/// exactly one range of the search, and the prefix it shares with each bound of that range is
+/// stored as a pair of bytes. Prefixes of LCP_ESCAPE bytes or longer store LCP_ESCAPE and are
+/// kept exactly in the overflow entries, the position of the byte in the high half and the prefix
+/// length in the low half, sorted by position. Range bounds count from 1, so 0 and the number of
+/// suffixes plus 1 stand for sentinels sharing no prefix with any suffix.
+struct LcpTable {
+    lcps: Vec<u32>,
+    bounds: Vec<u8>,
+    overflow: Vec<u64>,
+}
+
+impl LcpTable {
+    fn new() -> Self {
+        LcpTable {
+            lcps: Vec::new(),
+            bounds: Vec::new(),
+            overflow: Vec::new(),
+        }
+    }
+
+    /// Computes the prefix every suffix shares with the previous one in suffix array order with the
+    /// permuted LCP array of Kärkkäinen et al., then reduces them to the ranges' bounds.
+    fn build(
+        &mut self,
+        buffer: &[u8],
+        suffix_array: &[i32],
+    ) {
+        let suffixes_count = suffix_array.len();
+        self.lcps.clear();
+        self.lcps.resize(suffixes_count, u32::MAX);
+        for suffixes in suffix_array.windows(2) {
+            self.lcps[suffixes[1] as usize] = suffixes[0] as u32;
+        }
+
+        let mut lcp = 0;
+        for data_index in 0..suffixes_count {
+            let previous_data_index = self.lcps[data_index];
+            if previous_data_index == u32::MAX {
+                lcp = 0;
+            } else {
+                let previous_suffix = &buffer[previous_data_index as usize..];
+                let suffix = &buffer[data_index..];
+                lcp += common_prefix_len(&previous_suffix[lcp..], &suffix[lcp..]);
+            }
+            self.lcps[data_index] = lcp as u32;
+            lcp = lcp.saturating_sub(1);
+        }
+
+        self.bounds.clear();
+        self.bounds.resize(suffixes_count * 2, 0);
+        self.overflow.clear();
+        self.fill_range(suffix_array, 0, suffixes_count + 1);
+        self.overflow.sort_unstable();
+    }
+
+    fn fill_range(
+        &mut self,
+        suffix_array: &[i32],
+        low: usize,
+        high: usize,
+    ) -> u32 {
+        if high - low == 1 {
+            if low == 0 || high == suffix_array.len() + 1 {
+                return 0;
+            }
+
+            return self.lcps[suffix_array[high - 1] as usize];
+        }
+
+        let middle = low + (high - low) / 2;
+        let low_lcp = self.fill_range(suffix_array, low, middle);
+        let high_lcp = self.fill_range(suffix_array, middle, high);
+        self.store((middle - 1) * 2, low_lcp);
+        self.store((middle - 1) * 2 + 1, high_lcp);
+
+        low_lcp.min(high_lcp)
+    }
+
+    fn store(
+        &mut self,
+        position: usize,
+        lcp: u32,
+    ) {
+        if lcp < LCP_ESCAPE as u32 {
+            self.bounds[position] = lcp as u8;
+        } else {
+            self.bounds[position] = LCP_ESCAPE;
+            self.overflow.push((position as u64) << 32 | lcp as u64);
+        }
+    }
+}
+
+/// Samples the number of lines before every LINE_RANKS_INTERVAL bytes of the text, so the entry
+/// ordinal of a line is found by counting the line ends from the last sample before it only.
+fn build_line_ranks(
+    line_ranks: &mut Vec<u32>,
+    buffer: &[u8],
+) {
+    line_ranks.clear();
+    let mut line_rank = 0;
+    for text_block in buffer.chunks(LINE_RANKS_INTERVAL) {
+        line_ranks.push(line_rank);
+        line_rank += memchr::memchr_iter(b'\n', text_block).count() as u32;
+    }
+}
+
+fn build_suffix_prefixes(
+    suffix_prefixes: &mut Vec<u32>,
     buffer: &[u8],
-) -> Vec<i32> {
-    let mut suffix_array = vec![0; buffer.len()];
-
-    unsafe {
-        libsais(
-            buffer.as_ptr(),
-            suffix_array.as_mut_ptr(),
-            buffer.len() as i32,
-            0,
-            std::ptr::null_mut::<i32>(),
+    suffix_array: &[i32],
+) {
+    suffix_prefixes.clear();
+    suffix_prefixes.extend(
+        suffix_array.iter().map(|&data_index| (suffix_key(buffer, data_index as usize) >> 32) as u32)
+    );
+}
+
+/// The tables a worker builds next to the suffix array of every chunk. They are kept across
+/// chunks so their buffers are reused.
+struct ChunkTables {
+    suffix_prefixes: Vec<u32>,
+    suffix_samples: SuffixSamples,
+    qgram_table: QgramTable,
+    lcp_table: LcpTable,
+    line_ranks: Vec<u32>,
+}
+
+impl ChunkTables {
+    fn new() -> Self {
+        ChunkTables {
+            suffix_prefixes: Vec::new(),
+            suffix_samples: SuffixSamples::new(),
+            qgram_table: QgramTable::new(),
+            lcp_table: LcpTable::new(),
+            line_ranks: Vec::new(),
+        }
+    }
+}
+
+struct Chunk {
+    id: usize,
+    buffer: Vec<u8>,
+    entries: usize,
+}
+
+struct ChunksOutput {
+    index_file: BufWriter<File>,
+    offset: usize,
+    chunks: Vec<ChunkInfo>,
+    chunks_table_written: bool,
+    next_chunk_id: usize,
+    failed: bool,
+}
+
+impl ChunksOutput {
+    fn write_chunk(
+        &mut self,
+        buffer: &[u8],
+        entries: usize,
+        suffix_array: &[i32],
+        chunk_tables: &ChunkTables,
+    ) -> io::Result<()> {
+        let ChunkTables { suffix_prefixes, suffix_samples, qgram_table, lcp_table, line_ranks } = chunk_tables;
+
+        let text = Section {
+            offset: self.offset,
+            len: buffer.len(),
+        };
+        self.index_file.write_all(buffer)?;
+        self.pad_section(&text)?;
+
+        let suffixes = Section {
+            offset: self.offset,
+            len: std::mem::size_of_val(suffix_array) + std::mem::size_of_val(&suffix_prefixes[..]),
+        };
+        if suffix_prefixes.is_empty() {
+            write_slice(&mut self.index_file, suffix_array)?;
+        } else {
+            write_suffixes_with_prefixes(&mut self.index_file, suffix_array, suffix_prefixes)?;
+        }
+        self.pad_section(&suffixes)?;
+
+        let samples = Section {
+            offset: self.offset,
+            len: std::mem::size_of_val(&suffix_samples.keys[..]) + std::mem::size_of_val(&suffix_samples.ranks[..]),
+        };
+        write_slice(&mut self.index_file, &suffix_samples.keys)?;
+        write_slice(&mut self.index_file, &suffix_samples.ranks)?;
+        self.pad_section(&samples)?;
+
+        let qgrams = Section {
+            offset: self.offset,
+            len: std::mem::size_of_val(&qgram_table.bounds[..]),
+        };
+        write_slice(&mut self.index_file, &qgram_table.bounds)?;
+        self.pad_section(&qgrams)?;
+
+        let lcp_bounds = Section {
+            offset: self.offset,
+            len: lcp_table.bounds.len(),
+        };
+        write_slice(&mut self.index_file, &lcp_table.bounds)?;
+        self.pad_section(&lcp_bounds)?;
+
+        let lcp_overflow = Section {
+            offset: self.offset,
+            len: std::mem::size_of_val(&lcp_table.overflow[..]),
+        };
+        write_slice(&mut self.index_file, &lcp_table.overflow)?;
+        self.pad_section(&lcp_overflow)?;
+
+        let line_ranks = Section {
+            offset: self.offset,
+            len: std::mem::size_of_val(&line_ranks[..]),
+        };
+        write_slice(&mut self.index_file, &chunk_tables.line_ranks)?;
+        self.pad_section(&line_ranks)?;
+
+        self.chunks.push(
+            ChunkInfo {
+                entries: Some(entries),
+                text,
+                suffixes,
+                samples,
+                samples_rate: SUFFIX_SAMPLES_RATE,
+                qgrams,
+                suffix_prefix_len: if suffix_prefixes.is_empty() { 0 } else { SUFFIX_PREFIX_LEN },
+                lcp_bounds,
+                lcp_overflow,
+                line_ranks,
+            }
         );
+        self.chunks_table_written = false;
+
+        self.index_file.flush()
+    }
+
+    fn pad_section(
+        &mut self,
+        section: &Section,
+    ) -> io::Result<()> {
+        let padding_len = padding_len(section.len);
+        self.index_file.write_all(&[0; 8][..padding_len])?;
+        self.offset += section.len + padding_len;
+
+        Ok(())
+    }
+
+    /// Appends the table of every chunk written so far followed by a fixed size trailer pointing
+    /// at it, so a Reader can locate all the chunks by reading the end of the file. A table
+    /// written by an earlier finalize is left in place and superseded by the new one.
+    fn write_chunks_table(
+        &mut self,
+    ) -> io::Result<()> {
+        let chunks_table_offset = self.offset;
+        for chunk in &self.chunks {
+            let fields = [
+                chunk.entries.unwrap_or_default(),
+                chunk.text.offset,
+                chunk.text.len,
+                chunk.suffixes.offset,
+                chunk.suffixes.len,
+                chunk.samples.offset,
+                chunk.samples.len,
+                chunk.samples_rate,
+                chunk.qgrams.offset,
+                chunk.qgrams.len,
+                chunk.suffix_prefix_len,
+                chunk.lcp_bounds.offset,
+                chunk.lcp_bounds.len,
+                chunk.lcp_overflow.offset,
+                chunk.lcp_overflow.len,
+                chunk.line_ranks.offset,
+                chunk.line_ranks.len,
+            ];
+            for value in fields {
+                self.index_file.write_u64::<LittleEndian>(value as u64)?;
+            }
+        }
+        self.index_file.write_u64::<LittleEndian>(chunks_table_offset as u64)?;
+        self.index_file.write_u64::<LittleEndian>(self.chunks.len() as u64)?;
+        self.index_file.write_u32::<LittleEndian>(INDEX_FILE_VERSION)?;
+        self.index_file.write_all(INDEX_FILE_MAGIC)?;
+
+        self.offset += self.chunks.len() * CHUNKS_TABLE_ENTRY_FIELDS * 8 + INDEX_FILE_TRAILER_LEN;
+        self.chunks_table_written = true;
+
+        self.index_file.flush()
     }
+}
+
+/// Constructs the chunks handed over by the Writer in the background. Several workers may sort
+/// different chunks at the same time, but each one waits for its turn before writing so chunks
+/// land in the index file in the order they were added. Every written buffer is returned so the
+/// Writer can reuse it, and a failure is reported through the same channel.
+fn chunks_worker(
+    output: Arc<(Mutex<ChunksOutput>, Condvar)>,
+    threads: i32,
+    inline_prefixes: bool,
+    lcp_bounds: bool,
+    chunks_receiver: Arc<Mutex<Receiver<Chunk>>>,
+    buffers_sender: Sender<io::Result<Vec<u8>>>,
+) {
+    let mut suffix_array_builder = SuffixArrayBuilder::new(threads);
+    let mut chunk_tables = ChunkTables::new();
+
+    loop {
+        let next_chunk = chunks_receiver.lock().recv();
+        let mut chunk = match next_chunk {
+            Ok(chunk) => chunk,
+            Err(_) => break,
+        };
+
+        let suffix_array = suffix_array_builder.construct(&chunk.buffer);
+        if let Ok(suffix_array) = &suffix_array {
+            chunk_tables.suffix_samples.build(&chunk.buffer, suffix_array);
+            chunk_tables.qgram_table.build(&chunk.buffer);
+            build_line_ranks(&mut chunk_tables.line_ranks, &chunk.buffer);
+            if inline_prefixes {
+                build_suffix_prefixes(&mut chunk_tables.suffix_prefixes, &chunk.buffer, suffix_array);
+            }
+            if lcp_bounds {
+                chunk_tables.lcp_table.build(&chunk.buffer, suffix_array);
+            }
+        }
 
-    suffix_array
+        let (output, output_turn) = &*output;
+        let mut output = output.lock();
+        while output.next_chunk_id != chunk.id && !output.failed {
+            output_turn.wait(&mut output);
+        }
+        if output.failed {
+            break;
+        }
+
+        let written = suffix_array.and_then(
+            |suffix_array| output.write_chunk(&chunk.buffer, chunk.entries, suffix_array, &chunk_tables)
+        );
+        output.next_chunk_id += 1;
+        output.failed = written.is_err();
+        output_turn.notify_all();
+        drop(output);
+
+        chunk.buffer.clear();
+        if buffers_sender.send(written.map(|_| chunk.buffer)).is_err() {
+            break;
+        }
+    }
 }
 
 #[pyclass]
 struct Writer {
-    index_file: BufWriter<File>,
     buffer: Vec<u8>,
+    buffer_entries: usize,
+    next_chunk_id: usize,
+    pending_chunks: usize,
+    output: Arc<(Mutex<ChunksOutput>, Condvar)>,
+    chunks_sender: Option<Sender<Chunk>>,
+    buffers_receiver: Receiver<io::Result<Vec<u8>>>,
+    workers: Vec<JoinHandle<()>>,
 }
 
 #[pymethods]
@@ -51,34 +780,96 @@ impl Writer {
     fn new(
         index_file_path: &str,
         max_chunk_len: Option<usize>,
+        threads: Option<usize>,
+        concurrent_chunks: Option<usize>,
+        inline_prefixes: Option<bool>,
+        lcp_bounds: Option<bool>,
     ) -> PyResult<Self> {
-        let index_file = File::create(index_file_path)?;
-        let index_file = BufWriter::new(index_file);
         let max_chunk_len = max_chunk_len.unwrap_or(512 * 1024 * 1024);
+        if max_chunk_len > MAX_CHUNK_LEN {
+            return Err(
+                exceptions::PyValueError::new_err(
+                    format!("max_chunk_len must not exceed {} bytes", MAX_CHUNK_LEN)
+                )
+            );
+        }
+
+        let index_file = File::create(index_file_path)?;
+        let mut index_file = BufWriter::new(index_file);
+        index_file.write_all(INDEX_FILE_MAGIC)?;
+        index_file.write_u32::<LittleEndian>(INDEX_FILE_VERSION)?;
+
+        let threads = threads.unwrap_or(1).min(i32::MAX as usize) as i32;
+        let concurrent_chunks = concurrent_chunks.unwrap_or(1).max(1);
+        let inline_prefixes = inline_prefixes.unwrap_or(false);
+        let lcp_bounds = lcp_bounds.unwrap_or(false);
+
+        let output = Arc::new(
+            (
+                Mutex::new(
+                    ChunksOutput {
+                        index_file,
+                        offset: INDEX_FILE_HEADER_LEN,
+                        chunks: Vec::new(),
+                        chunks_table_written: false,
+                        next_chunk_id: 0,
+                        failed: false,
+                    }
+                ),
+                Condvar::new(),
+            )
+        );
+        let (chunks_sender, chunks_receiver) = mpsc::channel();
+        let chunks_receiver = Arc::new(Mutex::new(chunks_receiver));
+        let (buffers_sender, buffers_receiver) = mpsc::channel();
+        let workers = (0..concurrent_chunks).map(
+            |_| {
+                let output = output.clone();
+                let chunks_receiver = chunks_receiver.clone();
+                let buffers_sender = buffers_sender.clone();
+
+                thread::spawn(
+                    move || chunks_worker(output, threads, inline_prefixes, lcp_bounds, chunks_receiver, buffers_sender)
+                )
+            }
+        ).collect();
 
         Ok(
             Writer {
-                index_file,
                 buffer: Vec::with_capacity(max_chunk_len),
+                buffer_entries: 0,
+                next_chunk_id: 0,
+                pending_chunks: 0,
+                output,
+                chunks_sender: Some(chunks_sender),
+                buffers_receiver,
+                workers,
             }
         )
     }
 
     fn add_entries_from_file_lines(
         &mut self,
+        py: Python,
         input_file_path: &str,
     ) -> PyResult<()> {
         let input_file = File::open(input_file_path)?;
         let input_file_reader = BufReader::new(input_file);
-        input_file_reader.for_byte_line(
-            |line| {
-                if self.buffer.len() + line.len() + 1 > self.buffer.capacity() {
-                    self.dump_data()?;
-                }
-                self.buffer.extend_from_slice(line);
-                self.buffer.push(b'\n');
 
-                Ok(true)
+        py.allow_threads(
+            || {
+                input_file_reader.for_byte_line(
+                    |line| {
+                        if self.buffer.len() + line.len() + 1 > self.buffer.capacity() {
+                            self.write_chunk()?;
+                        }
+                        self.buffer.extend_from_slice(line);
+                        self.buffer.push(b'\n');
+                        self.buffer_entries += 1;
+
+                        Ok(true)
+                    }
+                )
             }
         )?;
 
@@ -87,6 +878,7 @@ impl Writer {
 
     fn add_entry(
         &mut self,
+        py: Python,
         text: &str,
     ) -> PyResult<()> {
         if text.len() > self.buffer.capacity() {
@@ -94,196 +886,2758 @@ impl Writer {
         }
 
         if self.buffer.len() + text.len() + 1 > self.buffer.capacity() {
-            self.dump_data()?;
+            py.allow_threads(|| self.write_chunk())?;
         }
         self.buffer.extend_from_slice(text.as_bytes());
         self.buffer.push(b'\n');
+        // Entries are numbered by line, like the lines a search returns, so an entry holding line
+        // breaks counts once for every line.
+        self.buffer_entries += 1 + memchr::memchr_iter(b'\n', text.as_bytes()).count();
 
         Ok(())
     }
 
     fn dump_data(
         &mut self,
+        py: Python,
     ) -> PyResult<()> {
-        if self.buffer.is_empty() {
-            return Ok(());
-        }
-
-        self.index_file.write_u32::<LittleEndian>(self.buffer.len() as u32)?;
-        self.index_file.write_all(&self.buffer)?;
-
-        let suffix_array = construct_suffix_array(&self.buffer);
-        self.index_file.write_u32::<LittleEndian>((suffix_array.len() * 4) as u32)?;
-        for suffix in suffix_array {
-            self.index_file.write_i32::<LittleEndian>(suffix)?;
-        }
-
-        self.buffer.clear();
+        py.allow_threads(|| self.write_chunk())?;
 
         Ok(())
     }
 
     fn finalize(
         &mut self,
+        py: Python,
     ) -> PyResult<()> {
-        if !self.buffer.is_empty() {
-            self.dump_data()?;
-        }
-        self.index_file.flush()?;
+        py.allow_threads(|| self.flush())?;
 
         Ok(())
     }
 }
 
-impl Drop for Writer {
-    fn drop(
+impl Writer {
+    fn write_chunk(
         &mut self,
-    ) {
-        self.finalize().unwrap();
-    }
-}
+    ) -> io::Result<()> {
+        if self.buffer.is_empty() {
+            return Ok(());
+        }
+        // Buffers still queued by workers that ran before a failure closed the Writer are not
+        // accounted for anymore, so none may be taken once it is closed.
+        if self.chunks_sender.is_none() {
+            return Err(io::Error::other("index writer is closed"));
+        }
 
-struct SubIndex {
-    data: Vec<u8>,
-    index_file: BufReader<File>,
-    suffixes_file_start: usize,
-    suffixes_file_end: usize,
-    finder: memmem::Finder<'static>,
-    finder_rev: memmem::FinderRev<'static>,
-}
+        // Every worker holds at most one chunk, so the Writer never holds more buffers than the
+        // number of workers plus the one being filled.
+        let next_buffer = if self.pending_chunks < self.workers.len() {
+            Vec::with_capacity(self.buffer.capacity())
+        } else {
+            self.receive_buffer()?
+        };
 
-#[pyclass]
-struct Reader {
-    sub_indexes: Vec<SubIndex>,
-}
+        let chunk = Chunk {
+            id: self.next_chunk_id,
+            buffer: std::mem::replace(&mut self.buffer, next_buffer),
+            entries: std::mem::take(&mut self.buffer_entries),
+        };
+        let sent = match &self.chunks_sender {
+            Some(chunks_sender) => chunks_sender.send(chunk).is_ok(),
+            None => false,
+        };
+        if !sent {
+            self.close();
 
-#[pymethods]
-impl Reader {
+            return Err(io::Error::other("index writer is closed"));
+        }
+        self.next_chunk_id += 1;
+        self.pending_chunks += 1;
+
+        Ok(())
+    }
+
+    fn receive_buffer(
+        &mut self,
+    ) -> io::Result<Vec<u8>> {
+        match self.buffers_receiver.recv() {
+            Ok(Ok(buffer)) => {
+                self.pending_chunks -= 1;
+
+                Ok(buffer)
+            },
+            Ok(Err(error)) => {
+                self.close();
+
+                Err(error)
+            },
+            Err(_) => {
+                self.close();
+
+                Err(io::Error::other("index writer is closed"))
+            },
+        }
+    }
+
+    fn close(
+        &mut self,
+    ) {
+        self.chunks_sender = None;
+        self.pending_chunks = 0;
+
+        for worker in self.workers.drain(..) {
+            worker.join().unwrap();
+        }
+    }
+
+    fn flush(
+        &mut self,
+    ) -> io::Result<()> {
+        self.write_chunk()?;
+        while self.pending_chunks > 0 {
+            self.receive_buffer()?;
+        }
+
+        let mut output = self.output.0.lock();
+        if output.failed {
+            return Err(io::Error::other("index writer is closed"));
+        }
+        if !output.chunks_table_written {
+            output.write_chunks_table()?;
+        }
+
+        Ok(())
+    }
+}
+
+impl Drop for Writer {
+    fn drop(
+        &mut self,
+    ) {
+        if self.chunks_sender.is_some() {
+            self.flush().unwrap();
+        }
+        self.close();
+    }
+}
+
+fn padding_len(
+    section_len: usize,
+) -> usize {
+    (8 - section_len % 8) % 8
+}
+
+#[derive(Clone, Copy)]
+struct Section {
+    offset: usize,
+    len: usize,
+}
+
+impl Section {
+    fn end(
+        &self,
+    ) -> usize {
+        self.offset + self.len
+    }
+}
+
+struct ChunkInfo {
+    entries: Option<usize>,
+    text: Section,
+    suffixes: Section,
+    samples: Section,
+    samples_rate: usize,
+    qgrams: Section,
+    suffix_prefix_len: usize,
+    lcp_bounds: Section,
+    lcp_overflow: Section,
+    line_ranks: Section,
+}
+
+impl ChunkInfo {
+    /// The bytes the chunk takes once loaded in memory.
+    fn resident_len(
+        &self,
+    ) -> usize {
+        self.text.len + self.suffixes.len + self.samples.len + self.qgrams.len + self.lcp_bounds.len +
+            self.lcp_overflow.len + self.line_ranks.len
+    }
+
+    fn suffixes_stride(
+        &self,
+    ) -> usize {
+        1 + self.suffix_prefix_len / 4
+    }
+
+    fn samples_count(
+        &self,
+    ) -> usize {
+        match self.samples_rate {
+            0 => 0,
+            samples_rate => self.text.len.div_ceil(samples_rate),
+        }
+    }
+
+    fn sample_keys(
+        &self,
+    ) -> Section {
+        Section {
+            offset: self.samples.offset,
+            len: self.samples_count() * 8,
+        }
+    }
+
+    fn sample_ranks(
+        &self,
+    ) -> Section {
+        Section {
+            offset: self.sample_keys().end(),
+            len: self.samples_count() * 4,
+        }
+    }
+}
+
+fn index_file_corrupted() -> PyErr {
+    exceptions::PyValueError::new_err("index file is corrupted")
+}
+
+fn read_len(
+    index_file: &[u8],
+    offset: usize,
+    len_size: usize,
+) -> PyResult<usize> {
+    index_file.get(offset..offset.saturating_add(len_size))
+        .and_then(|len| usize::try_from(LittleEndian::read_uint(len, len_size)).ok())
+        .ok_or_else(index_file_corrupted)
+}
+
+fn is_versioned_index_file(
+    index_file: &File,
+) -> io::Result<bool> {
+    let mut magic = [0; 4];
+    match read_exact_at(index_file, &mut magic, 0) {
+        Ok(()) => Ok(&magic == INDEX_FILE_MAGIC),
+        Err(err) if err.kind() == io::ErrorKind::UnexpectedEof => Ok(false),
+        Err(err) => Err(err),
+    }
+}
+
+/// Locates the chunks through the table the Writer appends on finalize, which is found through
+/// the fixed size trailer at the end of the file. Only the header, the trailer and the table are
+/// read, using positional reads so no mapping of the file is needed.
+fn read_chunks_table(
+    index_file: &File,
+) -> PyResult<Vec<ChunkInfo>> {
+    let index_file_len = usize::try_from(index_file.metadata()?.len()).map_err(|_| index_file_corrupted())?;
+    if index_file_len < INDEX_FILE_HEADER_LEN + INDEX_FILE_TRAILER_LEN {
+        return Err(index_file_corrupted());
+    }
+
+    let mut header = [0; INDEX_FILE_HEADER_LEN];
+    read_exact_at(index_file, &mut header, 0)?;
+    if read_len(&header, 4, 4)? != INDEX_FILE_VERSION as usize {
+        return Err(exceptions::PyValueError::new_err("unsupported index file version"));
+    }
+    let entry_len = CHUNKS_TABLE_ENTRY_FIELDS * 8;
+
+    let trailer_offset = index_file_len - INDEX_FILE_TRAILER_LEN;
+    let mut trailer = [0; INDEX_FILE_TRAILER_LEN];
+    read_exact_at(index_file, &mut trailer, trailer_offset as u64)?;
+    if !trailer.ends_with(INDEX_FILE_MAGIC) {
+        return Err(exceptions::PyValueError::new_err("index file was not finalized"));
+    }
+    let chunks_table_offset = read_len(&trailer, 0, 8)?;
+    let chunks_count = read_len(&trailer, 8, 8)?;
+    let chunks_table_len = chunks_count.checked_mul(entry_len)
+        .filter(|&chunks_table_len| Some(chunks_table_len) == trailer_offset.checked_sub(chunks_table_offset))
+        .ok_or_else(index_file_corrupted)?;
+    let mut chunks_table = vec![0; chunks_table_len];
+    read_exact_at(index_file, &mut chunks_table, chunks_table_offset as u64)?;
+
+    chunks_table.chunks_exact(entry_len).map(
+        |chunks_table_entry| {
+            let field = |field_index: usize| read_len(chunks_table_entry, field_index * 8, 8);
+            let chunk = ChunkInfo {
+                entries: Some(field(0)?),
+                text: Section {
+                    offset: field(1)?,
+                    len: field(2)?,
+                },
+                suffixes: Section {
+                    offset: field(3)?,
+                    len: field(4)?,
+                },
+                samples: Section {
+                    offset: field(5)?,
+                    len: field(6)?,
+                },
+                samples_rate: field(7)?,
+                qgrams: Section {
+                    offset: field(8)?,
+                    len: field(9)?,
+                },
+                suffix_prefix_len: field(10)?,
+                lcp_bounds: Section {
+                    offset: field(11)?,
+                    len: field(12)?,
+                },
+                lcp_overflow: Section {
+                    offset: field(13)?,
+                    len: field(14)?,
+                },
+                line_ranks: Section {
+                    offset: field(15)?,
+                    len: field(16)?,
+                },
+            };
+
+            for section in [chunk.text, chunk.suffixes, chunk.samples, chunk.qgrams, chunk.lcp_bounds, chunk.lcp_overflow, chunk.line_ranks] {
+                if section.offset.checked_add(section.len).filter(|&end| end <= chunks_table_offset).is_none() {
+                    return Err(index_file_corrupted());
+                }
+            }
+            if ![0, SUFFIX_PREFIX_LEN].contains(&chunk.suffix_prefix_len) {
+                return Err(index_file_corrupted());
+            }
+            if chunk.suffixes.len != chunk.text.len * 4 * chunk.suffixes_stride() || chunk.samples.len != chunk.samples_count() * 12 {
+                return Err(index_file_corrupted());
+            }
+            if chunk.qgrams.len != 0 && chunk.qgrams.len != QGRAM_BOUNDS_COUNT * 4 {
+                return Err(index_file_corrupted());
+            }
+            if chunk.lcp_bounds.len != 0 && chunk.lcp_bounds.len != chunk.text.len * 2 {
+                return Err(index_file_corrupted());
+            }
+            if padding_len(chunk.lcp_overflow.len) != 0 || chunk.lcp_overflow.len > chunk.lcp_bounds.len * 8 {
+                return Err(index_file_corrupted());
+            }
+            if chunk.line_ranks.len != chunk.text.len.div_ceil(LINE_RANKS_INTERVAL) * 4 {
+                return Err(index_file_corrupted());
+            }
+
+            Ok(chunk)
+        }
+    ).collect()
+}
+
+/// Walks the chunks of an index file written before the format was versioned: sections are
+/// preceded by their 32 bit length, unaligned and there is no chunks table.
+fn read_legacy_chunks(
+    index_file: &[u8],
+) -> PyResult<Vec<ChunkInfo>> {
+    let mut chunks = Vec::new();
+
+    let mut bytes_read = 0;
+    while bytes_read < index_file.len() {
+        let text = Section {
+            offset: bytes_read + 4,
+            len: read_len(index_file, bytes_read, 4)?,
+        };
+        let suffixes = Section {
+            offset: text.end() + 4,
+            len: read_len(index_file, text.end(), 4)?,
+        };
+        if suffixes.end() > index_file.len() || suffixes.len != text.len * 4 {
+            return Err(index_file_corrupted());
+        }
+        bytes_read = suffixes.end();
+
+        chunks.push(
+            ChunkInfo {
+                // Counting the lines would read the whole text, so it is left to the searches that
+                // need it.
+                entries: None,
+                text,
+                suffixes,
+                samples: Section {
+                    offset: 0,
+                    len: 0,
+                },
+                samples_rate: 0,
+                qgrams: Section {
+                    offset: 0,
+                    len: 0,
+                },
+                suffix_prefix_len: 0,
+                lcp_bounds: Section {
+                    offset: 0,
+                    len: 0,
+                },
+                lcp_overflow: Section {
+                    offset: 0,
+                    len: 0,
+                },
+                line_ranks: Section {
+                    offset: 0,
+                    len: 0,
+                },
+            }
+        );
+    }
+
+    Ok(chunks)
+}
+
+#[cfg(unix)]
+fn read_exact_at(
+    file: &File,
+    buffer: &mut [u8],
+    offset: u64,
+) -> io::Result<()> {
+    std::os::unix::fs::FileExt::read_exact_at(file, buffer, offset)
+}
+
+#[cfg(windows)]
+fn read_exact_at(
+    file: &File,
+    mut buffer: &mut [u8],
+    mut offset: u64,
+) -> io::Result<()> {
+    while !buffer.is_empty() {
+        match std::os::windows::fs::FileExt::seek_read(file, buffer, offset) {
+            Ok(0) => return Err(io::ErrorKind::UnexpectedEof.into()),
+            Ok(bytes_read) => {
+                buffer = &mut buffer[bytes_read..];
+                offset += bytes_read as u64;
+            },
+            Err(err) if err.kind() == io::ErrorKind::Interrupted => {},
+            Err(err) => return Err(err),
+        }
+    }
+
+    Ok(())
+}
+
+/// Splits a large read into positional reads spread over the rayon pool, so loading is bound by
+/// the storage bandwidth rather than by a single reading thread.
+fn read_exact_at_parallel(
+    file: &File,
+    buffer: &mut [u8],
+    offset: usize,
+) -> io::Result<()> {
+    buffer.par_chunks_mut(LOAD_BLOCK_LEN).enumerate().try_for_each(
+        |(block_index, block)| read_exact_at(file, block, (offset + block_index * LOAD_BLOCK_LEN) as u64)
+    )
+}
+
+enum IndexFile {
+    Mapped(Mmap),
+    Resident {
+        words: Vec<u64>,
+        len: usize,
+    },
+}
+
+impl IndexFile {
+    /// Reads the whole file into memory. The buffer is backed by u64 words to keep the suffix
+    /// arrays aligned.
+    fn load(
+        index_file: &File,
+    ) -> io::Result<Self> {
+        let len = usize::try_from(index_file.metadata()?.len())
+            .map_err(|_| io::Error::other("index file is too large"))?;
+        let mut words = vec![0_u64; len.div_ceil(8)];
+        let bytes = unsafe { std::slice::from_raw_parts_mut(words.as_mut_ptr() as *mut u8, len) };
+        read_exact_at_parallel(index_file, bytes, 0)?;
+
+        Ok(IndexFile::Resident { words, len })
+    }
+}
+
+impl std::ops::Deref for IndexFile {
+    type Target = [u8];
+
+    fn deref(
+        &self,
+    ) -> &[u8] {
+        match self {
+            IndexFile::Mapped(index_file) => index_file,
+            IndexFile::Resident { words, len } => unsafe {
+                std::slice::from_raw_parts(words.as_ptr() as *const u8, *len)
+            },
+        }
+    }
+}
+
+/// A little endian array of the index file, which is used straight from the index file when the
+/// host byte order and the section's alignment allow it and copied otherwise.
+enum IndexArray<T> {
+    Mapped(Section),
+    Resident(Vec<T>),
+}
+
+impl<T: LittleEndianItem> IndexArray<T> {
+    fn new(
+        index_file: &[u8],
+        section: Section,
+    ) -> Self {
+        let items = &index_file[section.offset..section.end()];
+
+        if cfg!(target_endian = "little") {
+            let (head, _, tail) = unsafe { items.align_to::<T>() };
+            if head.is_empty() && tail.is_empty() {
+                return IndexArray::Mapped(section);
+            }
+        }
+
+        let mut resident = vec![T::default(); items.len() / std::mem::size_of::<T>()];
+        T::read_into(items, &mut resident);
+
+        IndexArray::Resident(resident)
+    }
+
+    fn as_slice<'a>(
+        &'a self,
+        index_file: &'a [u8],
+    ) -> &'a [T] {
+        match self {
+            IndexArray::Mapped(section) => {
+                let (_, items, _) = unsafe { index_file[section.offset..section.end()].align_to::<T>() };
+
+                items
+            },
+            IndexArray::Resident(items) => items,
+        }
+    }
+}
+
+fn read_array_at<T: LittleEndianItem>(
+    index_file: &File,
+    section: Section,
+) -> io::Result<Vec<T>> {
+    let mut items = vec![T::default(); section.len / std::mem::size_of::<T>()];
+    let bytes = unsafe {
+        std::slice::from_raw_parts_mut(items.as_mut_ptr() as *mut u8, std::mem::size_of_val(&items[..]))
+    };
+    read_exact_at_parallel(index_file, bytes, section.offset)?;
+    T::from_little_endian(&mut items);
+
+    Ok(items)
+}
+
+/// The arrays of a chunk of a mapped or a fully loaded index file.
+struct ChunkArrays {
+    suffixes: IndexArray<u32>,
+    sample_keys: IndexArray<u64>,
+    sample_ranks: IndexArray<u32>,
+    qgrams: IndexArray<u32>,
+    lcp_bounds: IndexArray<u8>,
+    lcp_overflow: IndexArray<u64>,
+    line_ranks: IndexArray<u32>,
+}
+
+impl ChunkArrays {
+    fn new(
+        index_file: &[u8],
+        chunk: &ChunkInfo,
+    ) -> Self {
+        ChunkArrays {
+            suffixes: IndexArray::new(index_file, chunk.suffixes),
+            sample_keys: IndexArray::new(index_file, chunk.sample_keys()),
+            sample_ranks: IndexArray::new(index_file, chunk.sample_ranks()),
+            qgrams: IndexArray::new(index_file, chunk.qgrams),
+            lcp_bounds: IndexArray::new(index_file, chunk.lcp_bounds),
+            lcp_overflow: IndexArray::new(index_file, chunk.lcp_overflow),
+            line_ranks: IndexArray::new(index_file, chunk.line_ranks),
+        }
+    }
+
+    fn memory_chunk<'a>(
+        &'a self,
+        index_file: &'a [u8],
+        chunk: &ChunkInfo,
+    ) -> MemoryChunk<'a> {
+        MemoryChunk {
+            data: &index_file[chunk.text.offset..chunk.text.end()],
+            suffixes: self.suffixes.as_slice(index_file),
+            suffixes_stride: chunk.suffixes_stride(),
+            sample_keys: self.sample_keys.as_slice(index_file),
+            sample_ranks: self.sample_ranks.as_slice(index_file),
+            samples_rate: chunk.samples_rate,
+            qgrams: self.qgrams.as_slice(index_file),
+            lcp_bounds: self.lcp_bounds.as_slice(index_file),
+            lcp_overflow: self.lcp_overflow.as_slice(index_file),
+            line_ranks: self.line_ranks.as_slice(index_file),
+        }
+    }
+}
+
+/// A chunk read into memory by a Reader with a bounded memory budget.
+struct ResidentChunk {
+    data: Vec<u8>,
+    suffixes: Vec<u32>,
+    sample_keys: Vec<u64>,
+    sample_ranks: Vec<u32>,
+    qgrams: Vec<u32>,
+    lcp_bounds: Vec<u8>,
+    lcp_overflow: Vec<u64>,
+    line_ranks: Vec<u32>,
+}
+
+impl ResidentChunk {
+    fn load(
+        index_file: &File,
+        chunk: &ChunkInfo,
+    ) -> io::Result<Self> {
+        let mut data = vec![0; chunk.text.len];
+        read_exact_at_parallel(index_file, &mut data, chunk.text.offset)?;
+
+        Ok(
+            ResidentChunk {
+                data,
+                suffixes: read_array_at(index_file, chunk.suffixes)?,
+                sample_keys: read_array_at(index_file, chunk.sample_keys())?,
+                sample_ranks: read_array_at(index_file, chunk.sample_ranks())?,
+                qgrams: read_array_at(index_file, chunk.qgrams)?,
+                lcp_bounds: read_array_at(index_file, chunk.lcp_bounds)?,
+                lcp_overflow: read_array_at(index_file, chunk.lcp_overflow)?,
+                line_ranks: read_array_at(index_file, chunk.line_ranks)?,
+            }
+        )
+    }
+
+    fn memory_chunk(
+        &self,
+        chunk: &ChunkInfo,
+    ) -> MemoryChunk<'_> {
+        MemoryChunk {
+            data: &self.data,
+            suffixes: &self.suffixes,
+            suffixes_stride: chunk.suffixes_stride(),
+            sample_keys: &self.sample_keys,
+            sample_ranks: &self.sample_ranks,
+            samples_rate: chunk.samples_rate,
+            qgrams: &self.qgrams,
+            lcp_bounds: &self.lcp_bounds,
+            lcp_overflow: &self.lcp_overflow,
+            line_ranks: &self.line_ranks,
+        }
+    }
+}
+
+enum ResidentSlot {
+    Unloaded,
+    Loading,
+    Resident(Arc<ResidentChunk>),
+}
+
+struct ChunkCacheState {
+    slots: Vec<ResidentSlot>,
+    resident_len: usize,
+}
+
+/// Keeps as many chunks in memory as the byte budget holds, and searches the others with
+/// positional reads through a block cache of their own, an eighth of the budget. Every search
+/// reads every chunk in about the same order, so resident chunks are never evicted to make room
+/// for others: each one loaded in their place would evict a chunk the next scan reads before it,
+/// and every search would read the whole index again. A chunk takes its share of the budget as soon
+/// as its load starts, and searches reaching a chunk being loaded wait for that single load.
+struct ChunkCache {
+    index_file: File,
+    max_resident_len: usize,
+    state: Mutex<ChunkCacheState>,
+    loaded: Condvar,
+    block_cache: BlockCache,
+}
+
+impl ChunkCache {
+    fn new(
+        index_file: File,
+        chunks_count: usize,
+        max_resident_len: usize,
+    ) -> io::Result<Self> {
+        let block_cache = BlockCache::new(index_file.try_clone()?, max_resident_len / 8)?;
+        let mut slots = Vec::with_capacity(chunks_count);
+        slots.resize_with(chunks_count, || ResidentSlot::Unloaded);
+
+        Ok(
+            ChunkCache {
+                index_file,
+                max_resident_len: max_resident_len - max_resident_len / 8,
+                state: Mutex::new(
+                    ChunkCacheState {
+                        slots,
+                        resident_len: 0,
+                    }
+                ),
+                loaded: Condvar::new(),
+                block_cache,
+            }
+        )
+    }
+
+    /// Returns the chunk from memory, loading it first if the budget holds it, or None when the
+    /// chunk is to be searched through the block cache instead.
+    fn get(
+        &self,
+        chunk_id: usize,
+        chunk: &ChunkInfo,
+    ) -> io::Result<Option<Arc<ResidentChunk>>> {
+        let mut state = self.state.lock();
+        loop {
+            match &state.slots[chunk_id] {
+                ResidentSlot::Resident(resident_chunk) => return Ok(Some(resident_chunk.clone())),
+                ResidentSlot::Unloaded => break,
+                ResidentSlot::Loading => {},
+            }
+            self.loaded.wait(&mut state);
+        }
+
+        let resident_len = chunk.resident_len();
+        if state.resident_len + resident_len > self.max_resident_len {
+            return Ok(None);
+        }
+        state.resident_len += resident_len;
+        state.slots[chunk_id] = ResidentSlot::Loading;
+        drop(state);
+
+        let loaded = ResidentChunk::load(&self.index_file, chunk).map(Arc::new);
+
+        let mut state = self.state.lock();
+        match &loaded {
+            Ok(resident_chunk) => state.slots[chunk_id] = ResidentSlot::Resident(resident_chunk.clone()),
+            Err(_) => {
+                state.resident_len -= resident_len;
+                state.slots[chunk_id] = ResidentSlot::Unloaded;
+            },
+        }
+        drop(state);
+        self.loaded.notify_all();
+
+        loaded.map(Some)
+    }
+}
+
+struct CachedBlock {
+    block_index: usize,
+    block: Arc<[u8]>,
+    referenced: bool,
+}
+
+struct BlockCacheShard {
+    blocks: Vec<CachedBlock>,
+    block_slots: AHashMap<usize, usize>,
+    clock_hand: usize,
+}
+
+impl BlockCacheShard {
+    fn get(
+        &mut self,
+        block_index: usize,
+        reference: bool,
+    ) -> Option<Arc<[u8]>> {
+        let cached_block = &mut self.blocks[*self.block_slots.get(&block_index)?];
+        cached_block.referenced |= reference;
+
+        Some(cached_block.block.clone())
+    }
+
+    /// Caches the block, in a free slot while the shard has one, or else in the first slot the
+    /// clock hand finds unreferenced since it last passed, clearing the references it passes.
+    fn insert(
+        &mut self,
+        block_index: usize,
+        block: Arc<[u8]>,
+        max_blocks: usize,
+    ) -> Arc<[u8]> {
+        if let Some(block) = self.get(block_index, false) {
+            return block;
+        }
+
+        let cached_block = CachedBlock {
+            block_index,
+            block: block.clone(),
+            referenced: false,
+        };
+        if self.blocks.len() < max_blocks {
+            self.block_slots.insert(block_index, self.blocks.len());
+            self.blocks.push(cached_block);
+
+            return block;
+        }
+        while self.blocks[self.clock_hand].referenced {
+            self.blocks[self.clock_hand].referenced = false;
+            self.clock_hand = (self.clock_hand + 1) % self.blocks.len();
+        }
+        let evicted_block = std::mem::replace(&mut self.blocks[self.clock_hand], cached_block);
+        self.block_slots.remove(&evicted_block.block_index);
+        self.block_slots.insert(block_index, self.clock_hand);
+        self.clock_hand = (self.clock_hand + 1) % self.blocks.len();
+
+        block
+    }
+}
+
+/// Keeps blocks of the index file within a byte budget. All the chunks share the file and the
+/// cache, so the suffix array entries probed by the first steps of every binary search are read
+/// from the file once and stay cached across queries. The cache is split into shards locked apart,
+/// so concurrent searches seldom wait on each other, and each shard evicts with the CLOCK
+/// algorithm, where a hit only marks its block as referenced. Lines are read around the cache
+/// rather than through it, so that scanning them never evicts the blocks the searches share.
+struct BlockCache {
+    index_file: File,
+    index_file_len: usize,
+    max_shard_blocks: usize,
+    shards: Vec<Mutex<BlockCacheShard>>,
+}
+
+impl BlockCache {
+    fn new(
+        index_file: File,
+        max_cached_len: usize,
+    ) -> io::Result<Self> {
+        let index_file_len = usize::try_from(index_file.metadata()?.len())
+            .map_err(|_| io::Error::other("index file is too large"))?;
+        let max_cached_blocks = max_cached_len / CACHE_BLOCK_LEN;
+        let shards_count = max_cached_blocks.clamp(1, BLOCK_CACHE_SHARDS);
+
+        Ok(
+            BlockCache {
+                index_file,
+                index_file_len,
+                max_shard_blocks: max_cached_blocks / shards_count,
+                shards: (0..shards_count).map(
+                    |_| Mutex::new(
+                        BlockCacheShard {
+                            blocks: Vec::new(),
+                            block_slots: AHashMap::new(),
+                            clock_hand: 0,
+                        }
+                    )
+                ).collect(),
+            }
+        )
+    }
+
+    fn shard(
+        &self,
+        block_index: usize,
+    ) -> &Mutex<BlockCacheShard> {
+        &self.shards[block_index % self.shards.len()]
+    }
+
+    fn read_block(
+        &self,
+        block_index: usize,
+    ) -> io::Result<Arc<[u8]>> {
+        let block_offset = block_index * CACHE_BLOCK_LEN;
+        let mut block = vec![0; CACHE_BLOCK_LEN.min(self.index_file_len.saturating_sub(block_offset))];
+        read_exact_at(&self.index_file, &mut block, block_offset as u64)?;
+
+        Ok(block.into())
+    }
+
+    fn block(
+        &self,
+        block_index: usize,
+    ) -> io::Result<Arc<[u8]>> {
+        if let Some(block) = self.shard(block_index).lock().get(block_index, true) {
+            return Ok(block);
+        }
+        let block = self.read_block(block_index)?;
+        if self.max_shard_blocks == 0 {
+            return Ok(block);
+        }
+
+        Ok(self.shard(block_index).lock().insert(block_index, block, self.max_shard_blocks))
+    }
+
+    /// Returns a block of text, from the cache when it holds the block already, but without
+    /// caching it or counting the hit.
+    fn text_block(
+        &self,
+        block_index: usize,
+    ) -> io::Result<Arc<[u8]>> {
+        match self.shard(block_index).lock().get(block_index, false) {
+            Some(block) => Ok(block),
+            None => self.read_block(block_index),
+        }
+    }
+
+    /// Reads text straight from the file, around the cache.
+    fn read_text_at(
+        &self,
+        buffer: &mut [u8],
+        offset: usize,
+    ) -> io::Result<()> {
+        read_exact_at(&self.index_file, buffer, offset as u64)
+    }
+
+    fn read_at(
+        &self,
+        buffer: &mut [u8],
+        offset: usize,
+    ) -> io::Result<()> {
+        let mut bytes_read = 0;
+        while bytes_read < buffer.len() {
+            let position = offset + bytes_read;
+            let block = self.block(position / CACHE_BLOCK_LEN)?;
+            let block = match block.get(position % CACHE_BLOCK_LEN..) {
+                Some(block) if !block.is_empty() => block,
+                _ => return Err(io::ErrorKind::UnexpectedEof.into()),
+            };
+            let len = block.len().min(buffer.len() - bytes_read);
+            buffer[bytes_read..bytes_read + len].copy_from_slice(&block[..len]);
+            bytes_read += len;
+        }
+
+        Ok(())
+    }
+}
+
+/// The parts of a chunk a search reads, whether the chunk is in memory or read through the block
+/// cache, so both run the same search.
+trait ChunkSource {
+    fn suffixes_count(
+        &self,
+    ) -> usize;
+
+    fn suffix(
+        &self,
+        suffix_index: usize,
+    ) -> io::Result<usize>;
+
+    /// The first bytes of the suffix stored next to its suffix array entry, when the index has them.
+    fn suffix_prefix(
+        &self,
+        suffix_index: usize,
+    ) -> io::Result<Option<u32>>;
+
+    /// Orders the suffix by its first substring length bytes, so Equal means it starts with the
+    /// substring, given that the first `skip` of them are known to match. Also returns how many
+    /// bytes match in total.
+    fn compare_suffix(
+        &self,
+        data_index: usize,
+        substring: &[u8],
+        skip: usize,
+    ) -> io::Result<(Ordering, usize)>;
+
+    fn samples_count(
+        &self,
+    ) -> usize;
+
+    fn samples_rate(
+        &self,
+    ) -> usize;
+
+    fn sample_key(
+        &self,
+        sample_index: usize,
+    ) -> io::Result<u64>;
+
+    fn sample_rank(
+        &self,
+        sample_index: usize,
+    ) -> io::Result<usize>;
+
+    fn has_qgrams(
+        &self,
+    ) -> bool;
+
+    fn qgram_bound(
+        &self,
+        qgram: usize,
+    ) -> io::Result<usize>;
+
+    fn has_lcp_bounds(
+        &self,
+    ) -> bool;
+
+    /// The offset of the first byte of the line holding the text byte.
+    fn line_tail(
+        &self,
+        data_index: usize,
+    ) -> io::Result<usize>;
+
+    /// The number of line ends in the text between the two offsets.
+    fn newlines_count(
+        &self,
+        start: usize,
+        end: usize,
+    ) -> io::Result<usize>;
+
+    fn has_line_ranks(
+        &self,
+    ) -> bool;
+
+    /// The number of line ends before the first byte of the text block, LINE_RANKS_INTERVAL bytes
+    /// long.
+    fn line_rank(
+        &self,
+        text_block_index: usize,
+    ) -> io::Result<usize>;
+
+    /// The prefixes the suffix shares with the low and the high bound of the search range it is
+    /// the middle of, as LcpTable stores them, with escaped ones looked up in the overflow.
+    fn lcp_bounds(
+        &self,
+        suffix_index: usize,
+    ) -> io::Result<(usize, usize)>;
+}
+
+/// The first bytes of a substring in the form of the suffix keys the index stores, to compare it
+/// with them before reading any text.
+struct SubstringKey {
+    key: u64,
+    mask: u64,
+    compared_len: usize,
+    zero_free_len: usize,
+    is_decisive: bool,
+}
+
+impl SubstringKey {
+    fn new(
+        substring: &[u8],
+        key_len: usize,
+    ) -> Self {
+        let compared_len = substring.len().min(key_len);
+        let mask = if compared_len == 8 { u64::MAX } else { !(u64::MAX >> (8 * compared_len)) };
+        let zero_free_len = memchr::memchr(0, &substring[..compared_len]).unwrap_or(compared_len);
+
+        SubstringKey {
+            key: suffix_key(substring, 0) & mask,
+            mask,
+            compared_len,
+            zero_free_len,
+            // A suffix shorter than its key is padded with zeros, so equal keys only mean the suffix
+            // starts with the substring when the substring fits the key and has no zeros.
+            is_decisive: substring.len() <= key_len && zero_free_len == compared_len,
+        }
+    }
+
+    /// Orders a suffix by its key against the substring, or returns None when only its text can.
+    fn compare(
+        &self,
+        suffix_key: u64,
+    ) -> Option<Ordering> {
+        match (suffix_key & self.mask).cmp(&self.key) {
+            Ordering::Equal if !self.is_decisive => None,
+            ordering => Some(ordering),
+        }
+    }
+
+    /// Like compare, also returning the number of bytes the suffix and the substring share. Bytes
+    /// past a zero of the substring may be the padding of a shorter suffix, so the text has to
+    /// tell how many match when the keys agree up to there.
+    fn compare_with_prefix_len(
+        &self,
+        suffix_key: u64,
+    ) -> Option<(Ordering, usize)> {
+        match self.compare(suffix_key)? {
+            Ordering::Equal => Some((Ordering::Equal, self.compared_len)),
+            ordering => {
+                let prefix_len = ((suffix_key & self.mask) ^ self.key).leading_zeros() as usize / 8;
+
+                (prefix_len < self.zero_free_len).then_some((ordering, prefix_len))
+            },
+        }
+    }
+}
+
+struct Query<'a> {
+    substring: &'a [u8],
+    sample_key: SubstringKey,
+    prefix_key: SubstringKey,
+}
+
+impl<'a> Query<'a> {
+    fn new(
+        substring: &'a [u8],
+    ) -> Self {
+        Query {
+            substring,
+            sample_key: SubstringKey::new(substring, 8),
+            prefix_key: SubstringKey::new(substring, SUFFIX_PREFIX_LEN),
+        }
+    }
+}
+
+/// Compares the suffix with the substring, given that their first `skip` bytes are known to match,
+/// and returns how many bytes match in total.
+fn compare_suffix_at(
+    source: &impl ChunkSource,
+    suffix_index: usize,
+    query: &Query,
+    skip: usize,
+) -> io::Result<(Ordering, usize)> {
+    if skip < SUFFIX_PREFIX_LEN {
+        if let Some(suffix_prefix) = source.suffix_prefix(suffix_index)? {
+            if let Some(comparison) = query.prefix_key.compare_with_prefix_len((suffix_prefix as u64) << 32) {
+                return Ok(comparison);
+            }
+        }
+    }
+
+    source.compare_suffix(source.suffix(suffix_index)?, query.substring, skip)
+}
+
+/// A range of suffixes holding a partition point, between the suffixes ranked `low` - 1 and
+/// `high` - 1, with the number of bytes each of them shares with the substring once known. Ranks
+/// count from 1, so 0 and the number of suffixes plus 1 stand for sentinels sharing no byte with
+/// the substring. With LCP bounds the range is always one of the Manber-Myers search ranges the
+/// Writer stored the prefixes for.
+#[derive(Clone, Copy)]
+struct SuffixRange {
+    low: usize,
+    high: usize,
+    low_lcp: Option<usize>,
+    high_lcp: Option<usize>,
+    has_lcp_bounds: bool,
+}
+
+impl SuffixRange {
+    fn new(
+        source: &impl ChunkSource,
+    ) -> Self {
+        SuffixRange {
+            low: 0,
+            high: source.suffixes_count() + 1,
+            low_lcp: Some(0),
+            high_lcp: Some(0),
+            has_lcp_bounds: source.has_lcp_bounds(),
+        }
+    }
+
+    fn middle(
+        &self,
+    ) -> usize {
+        self.low + (self.high - self.low) / 2
+    }
+
+    fn is_narrowed(
+        &self,
+    ) -> bool {
+        self.high - self.low == 1
+    }
+
+    fn partition_point(
+        &self,
+    ) -> usize {
+        self.high - 1
+    }
+
+    /// Narrows the range to the suffixes from `start` to `end`, known to hold the partition point
+    /// from the q-gram table or the samples. With LCP bounds the search ranges are descended
+    /// without comparing anything until one has its middle within them.
+    fn narrow_to(
+        &mut self,
+        start: usize,
+        end: usize,
+    ) {
+        let low_target = start.max(self.low);
+        let high_target = (end + 1).min(self.high);
+
+        if !self.has_lcp_bounds {
+            if low_target > self.low {
+                self.low = low_target;
+                self.low_lcp = None;
+            }
+            if high_target < self.high {
+                self.high = high_target;
+                self.high_lcp = None;
+            }
+
+            return;
+        }
+
+        while !self.is_narrowed() {
+            let middle = self.middle();
+            if middle <= low_target {
+                self.low = middle;
+                self.low_lcp = None;
+            } else if middle >= high_target {
+                self.high = middle;
+                self.high_lcp = None;
+            } else {
+                break;
+            }
+        }
+    }
+
+    /// Compares the middle suffix with the substring, starting past the bytes both bounds share
+    /// with it, since every suffix in between shares them too. With LCP bounds the prefixes the
+    /// middle suffix shares with the bounds mostly tell its order without reading its text, and
+    /// when they do not, its text is compared from the first byte not known to match, so every
+    /// byte of the substring is compared about once.
+    fn compare_middle(
+        &mut self,
+        source: &impl ChunkSource,
+        query: &Query,
+    ) -> io::Result<(Ordering, usize)> {
+        let middle = self.middle();
+        if !self.has_lcp_bounds {
+            let skip = self.low_lcp.unwrap_or(0).min(self.high_lcp.unwrap_or(0));
+
+            return compare_suffix_at(source, middle - 1, query, skip);
+        }
+
+        let low_lcp = match self.low_lcp {
+            Some(low_lcp) => low_lcp,
+            None => compare_suffix_at(source, self.low - 1, query, 0)?.1,
+        };
+        let high_lcp = match self.high_lcp {
+            Some(high_lcp) => high_lcp,
+            None => compare_suffix_at(source, self.high - 1, query, 0)?.1,
+        };
+        self.low_lcp = Some(low_lcp);
+        self.high_lcp = Some(high_lcp);
+
+        // The middle suffix is compared through the bound sharing the longer prefix with the
+        // substring, as it tells more about the middle suffix.
+        let (low_middle_lcp, middle_high_lcp) = source.lcp_bounds(middle - 1)?;
+        let (is_low_bound, bound_lcp, middle_lcp) = match low_lcp >= high_lcp {
+            true => (true, low_lcp, low_middle_lcp),
+            false => (false, high_lcp, middle_high_lcp),
+        };
+        let side_of = |is_low_side: bool, prefix_len: usize| match (prefix_len == query.substring.len(), is_low_side) {
+            (true, _) => (Ordering::Equal, prefix_len),
+            (false, true) => (Ordering::Less, prefix_len),
+            (false, false) => (Ordering::Greater, prefix_len),
+        };
+
+        if middle_lcp > bound_lcp {
+            Ok(side_of(is_low_bound, bound_lcp))
+        } else if middle_lcp < bound_lcp {
+            Ok(side_of(!is_low_bound, middle_lcp))
+        } else {
+            compare_suffix_at(source, middle - 1, query, middle_lcp.min(bound_lcp))
+        }
+    }
+
+    fn narrow_at_middle(
+        &mut self,
+        is_middle_before: bool,
+        middle_lcp: usize,
+    ) {
+        let middle = self.middle();
+        if is_middle_before {
+            self.low = middle;
+            self.low_lcp = Some(middle_lcp);
+        } else {
+            self.high = middle;
+            self.high_lcp = Some(middle_lcp);
+        }
+    }
+
+    /// Narrows the range down to the first suffix for which `is_before` no longer holds.
+    fn partition(
+        mut self,
+        source: &impl ChunkSource,
+        query: &Query,
+        is_before: impl Fn(Ordering) -> bool,
+    ) -> io::Result<usize> {
+        while !self.is_narrowed() {
+            let (ordering, middle_lcp) = self.compare_middle(source, query)?;
+            self.narrow_at_middle(is_before(ordering), middle_lcp);
+        }
+
+        Ok(self.partition_point())
+    }
+}
+
+/// The range of suffixes between the samples surrounding an Eytzinger node, which is where a
+/// descent that reached the node left its partition point.
+fn sample_range(
+    source: &impl ChunkSource,
+    node: usize,
+) -> io::Result<(usize, usize)> {
+    let start = match node >> (node.trailing_zeros() + 1) {
+        0 => 0,
+        last_before => source.sample_rank(last_before - 1)? + 1,
+    };
+    let end = match node >> (node.trailing_ones() + 1) {
+        0 => source.suffixes_count(),
+        first_after => source.sample_rank(first_after - 1)?,
+    };
+
+    Ok((start, end))
+}
+
+/// Narrows the ranges of suffixes both partition points lie in to the suffixes between two samples,
+/// descending the Eytzinger ordered samples. The descents share their nodes until a sample starting
+/// with the substring, where the lower one goes left and the upper one right. Samples are compared
+/// by their keys and the text is only read for the ones whose key does not tell them apart from
+/// the substring, unless `stop_at_text` is set, in which case the ranges narrowed so far are
+/// returned instead.
+fn partition_samples(
+    source: &impl ChunkSource,
+    query: &Query,
+    stop_at_text: bool,
+) -> io::Result<((usize, usize), (usize, usize))> {
+    let samples_count = source.samples_count();
+    if samples_count == 0 {
+        return Ok(((0, source.suffixes_count()), (0, source.suffixes_count())));
+    }
+
+    let compare_sample = |node: usize| -> io::Result<Option<Ordering>> {
+        match query.sample_key.compare(source.sample_key(node - 1)?) {
+            Some(ordering) => Ok(Some(ordering)),
+            None if stop_at_text => Ok(None),
+            None => Ok(Some(source.compare_suffix(source.suffix(source.sample_rank(node - 1)?)?, query.substring, 0)?.0)),
+        }
+    };
+
+    let mut lower_node = 1;
+    let mut upper_node = None;
+    while lower_node <= samples_count {
+        let ordering = match compare_sample(lower_node)? {
+            Some(ordering) => ordering,
+            None => break,
+        };
+        if ordering == Ordering::Equal && upper_node.is_none() {
+            upper_node = Some(2 * lower_node + 1);
+        }
+        lower_node = 2 * lower_node + (ordering == Ordering::Less) as usize;
+    }
+
+    let mut upper_node = upper_node.unwrap_or(lower_node);
+    while upper_node <= samples_count {
+        let ordering = match compare_sample(upper_node)? {
+            Some(ordering) => ordering,
+            None => break,
+        };
+        upper_node = 2 * upper_node + (ordering != Ordering::Greater) as usize;
+    }
+
+    Ok((sample_range(source, lower_node)?, sample_range(source, upper_node)?))
+}
+
+/// Returns the range of suffixes starting with the first two bytes of the substring, or its first
+/// byte when it is shorter, which holds both partition points.
+fn qgram_range(
+    source: &impl ChunkSource,
+    substring: &[u8],
+) -> io::Result<(usize, usize)> {
+    if !source.has_qgrams() || substring.is_empty() {
+        return Ok((0, source.suffixes_count()));
+    }
+
+    let first_qgram = (substring[0] as usize) << 8;
+    let (start_qgram, end_qgram) = match substring.get(1) {
+        Some(&second_byte) => (first_qgram | second_byte as usize, (first_qgram | second_byte as usize) + 1),
+        None => (first_qgram, first_qgram + 256),
+    };
+
+    Ok((source.qgram_bound(start_qgram)?, source.qgram_bound(end_qgram)?))
+}
+
+/// Returns the range of the suffix array holding the suffixes that start with the substring. The
+/// q-gram table narrows the range first, then the samples unless the range is already no wider
+/// than the distance between two samples. With LCP bounds the sample descent stops at the first
+/// sample only the text tells apart from the substring, where the Manber-Myers search takes over.
+/// Both ends of the range are searched for together until a suffix starting with the substring
+/// splits the search in two, and each search carries on from the bounds reached so far.
+fn search_suffixes(
+    source: &impl ChunkSource,
+    substring: &[u8],
+) -> io::Result<(usize, usize)> {
+    let query = Query::new(substring);
+    let (start, end) = qgram_range(source, substring)?;
+    let (lower, upper) = if end - start > source.samples_rate() {
+        let (lower, upper) = partition_samples(source, &query, source.has_lcp_bounds())?;
+
+        ((start.max(lower.0), end.min(lower.1)), (start.max(upper.0), end.min(upper.1)))
+    } else {
+        ((start, end), (start, end))
+    };
+
+    let mut lower_range = SuffixRange::new(source);
+    lower_range.narrow_to(lower.0, upper.1);
+    let mut upper_range = loop {
+        if lower_range.is_narrowed() {
+            break lower_range;
+        }
+
+        let (ordering, middle_lcp) = lower_range.compare_middle(source, &query)?;
+        if ordering == Ordering::Equal {
+            let mut upper_range = lower_range;
+            upper_range.narrow_at_middle(true, middle_lcp);
+            lower_range.narrow_at_middle(false, middle_lcp);
+
+            break upper_range;
+        }
+        lower_range.narrow_at_middle(ordering == Ordering::Less, middle_lcp);
+    };
+    lower_range.narrow_to(lower.0, lower.1);
+    upper_range.narrow_to(upper.0, upper.1);
+
+    let start_of_indices = lower_range.partition(source, &query, |ordering| ordering == Ordering::Less)?;
+    let end_of_indices = upper_range.partition(source, &query, |ordering| ordering != Ordering::Greater)?;
+
+    Ok((start_of_indices, end_of_indices))
+}
+
+struct MemoryChunk<'a> {
+    data: &'a [u8],
+    suffixes: &'a [u32],
+    suffixes_stride: usize,
+    sample_keys: &'a [u64],
+    sample_ranks: &'a [u32],
+    samples_rate: usize,
+    qgrams: &'a [u32],
+    lcp_bounds: &'a [u8],
+    lcp_overflow: &'a [u64],
+    line_ranks: &'a [u32],
+}
+
+impl ChunkSource for MemoryChunk<'_> {
+    fn suffixes_count(
+        &self,
+    ) -> usize {
+        self.suffixes.len() / self.suffixes_stride
+    }
+
+    fn suffix(
+        &self,
+        suffix_index: usize,
+    ) -> io::Result<usize> {
+        Ok(self.suffixes[suffix_index * self.suffixes_stride] as usize)
+    }
+
+    fn suffix_prefix(
+        &self,
+        suffix_index: usize,
+    ) -> io::Result<Option<u32>> {
+        match self.suffixes_stride {
+            1 => Ok(None),
+            _ => Ok(Some(self.suffixes[suffix_index * self.suffixes_stride + 1])),
+        }
+    }
+
+    fn compare_suffix(
+        &self,
+        data_index: usize,
+        substring: &[u8],
+        skip: usize,
+    ) -> io::Result<(Ordering, usize)> {
+        Ok(compare_prefix(&self.data[data_index..], substring, skip))
+    }
+
+    fn samples_count(
+        &self,
+    ) -> usize {
+        self.sample_keys.len()
+    }
+
+    fn samples_rate(
+        &self,
+    ) -> usize {
+        self.samples_rate
+    }
+
+    fn sample_key(
+        &self,
+        sample_index: usize,
+    ) -> io::Result<u64> {
+        Ok(self.sample_keys[sample_index])
+    }
+
+    fn sample_rank(
+        &self,
+        sample_index: usize,
+    ) -> io::Result<usize> {
+        Ok(self.sample_ranks[sample_index] as usize)
+    }
+
+    fn has_qgrams(
+        &self,
+    ) -> bool {
+        !self.qgrams.is_empty()
+    }
+
+    fn qgram_bound(
+        &self,
+        qgram: usize,
+    ) -> io::Result<usize> {
+        Ok(self.qgrams[qgram] as usize)
+    }
+
+    fn has_lcp_bounds(
+        &self,
+    ) -> bool {
+        !self.lcp_bounds.is_empty()
+    }
+
+    fn line_tail(
+        &self,
+        data_index: usize,
+    ) -> io::Result<usize> {
+        match memchr::memrchr(b'\n', &self.data[..data_index]) {
+            Some(previous_nl_pos) => Ok(previous_nl_pos + 1),
+            None => Ok(0),
+        }
+    }
+
+    fn newlines_count(
+        &self,
+        start: usize,
+        end: usize,
+    ) -> io::Result<usize> {
+        Ok(memchr::memchr_iter(b'\n', &self.data[start..end]).count())
+    }
+
+    fn has_line_ranks(
+        &self,
+    ) -> bool {
+        !self.line_ranks.is_empty()
+    }
+
+    fn line_rank(
+        &self,
+        text_block_index: usize,
+    ) -> io::Result<usize> {
+        Ok(self.line_ranks[text_block_index] as usize)
+    }
+
+    fn lcp_bounds(
+        &self,
+        suffix_index: usize,
+    ) -> io::Result<(usize, usize)> {
+        let lcp_bound = |position: usize| match self.lcp_bounds[position] {
+            LCP_ESCAPE => overflowed_lcp(self.lcp_overflow.len(), position, |entry_index| Ok(self.lcp_overflow[entry_index])),
+            lcp => Ok(lcp as usize),
+        };
+
+        Ok((lcp_bound(suffix_index * 2)?, lcp_bound(suffix_index * 2 + 1)?))
+    }
+}
+
+/// Finds the exact length of an escaped LCP bound among the overflow entries of its chunk, read
+/// by their index through `entry`.
+fn overflowed_lcp(
+    entries_count: usize,
+    position: usize,
+    entry: impl Fn(usize) -> io::Result<u64>,
+) -> io::Result<usize> {
+    let mut low = 0;
+    let mut high = entries_count;
+    while low < high {
+        let middle = low + (high - low) / 2;
+        let entry = entry(middle)?;
+        match ((entry >> 32) as usize).cmp(&position) {
+            Ordering::Less => low = middle + 1,
+            Ordering::Greater => high = middle,
+            Ordering::Equal => return Ok((entry & u32::MAX as u64) as usize),
+        }
+    }
+
+    Err(io::Error::new(io::ErrorKind::InvalidData, "index file is corrupted"))
+}
+
+/// A chunk searched through the block cache. Every step of a search reads a few bytes of the
+/// samples, the suffix array and the text instead of the whole chunk being resident.
+struct PagedChunk<'a> {
+    block_cache: &'a BlockCache,
+    chunk: &'a ChunkInfo,
+}
+
+impl PagedChunk<'_> {
+    fn line_bounds(
+        &self,
+        data_index: usize,
+    ) -> io::Result<(usize, usize)> {
+        let text = &self.chunk.text;
+
+        let mut line_head = text.len - 1;
+        let mut position = text.offset + data_index;
+        while position < text.end() {
+            let block_offset = position / CACHE_BLOCK_LEN * CACHE_BLOCK_LEN;
+            let block = self.block_cache.text_block(position / CACHE_BLOCK_LEN)?;
+            let block_end = (block_offset + block.len()).min(text.end());
+            if let Some(next_nl_pos) = memchr::memchr(b'\n', &block[position - block_offset..block_end - block_offset]) {
+                line_head = position + next_nl_pos - text.offset;
+                break;
+            }
+            position = block_end;
+        }
+
+        Ok((self.line_tail(data_index)?, line_head))
+    }
+
+    fn read_u32(
+        &self,
+        offset: usize,
+    ) -> io::Result<u32> {
+        let mut value = [0; 4];
+        self.block_cache.read_at(&mut value, offset)?;
+
+        Ok(LittleEndian::read_u32(&value))
+    }
+}
+
+impl ChunkSource for PagedChunk<'_> {
+    fn suffixes_count(
+        &self,
+    ) -> usize {
+        self.chunk.suffixes.len / 4 / self.chunk.suffixes_stride()
+    }
+
+    fn suffix(
+        &self,
+        suffix_index: usize,
+    ) -> io::Result<usize> {
+        Ok(self.read_u32(self.chunk.suffixes.offset + suffix_index * 4 * self.chunk.suffixes_stride())? as usize)
+    }
+
+    fn suffix_prefix(
+        &self,
+        suffix_index: usize,
+    ) -> io::Result<Option<u32>> {
+        match self.chunk.suffix_prefix_len {
+            0 => Ok(None),
+            _ => Ok(Some(self.read_u32(self.chunk.suffixes.offset + suffix_index * 8 + 4)?)),
+        }
+    }
+
+    /// Compares the text block by block as it is found in the cache, without copying it.
+    fn compare_suffix(
+        &self,
+        data_index: usize,
+        substring: &[u8],
+        skip: usize,
+    ) -> io::Result<(Ordering, usize)> {
+        let compared_len = substring.len().min(self.chunk.text.len - data_index);
+        let position = self.chunk.text.offset + data_index;
+
+        let mut bytes_compared = skip;
+        while bytes_compared < compared_len {
+            let block_position = position + bytes_compared;
+            let block = self.block_cache.block(block_position / CACHE_BLOCK_LEN)?;
+            let block = &block[block_position % CACHE_BLOCK_LEN..];
+            let len = block.len().min(compared_len - bytes_compared);
+            match compare_prefix(&block[..len], &substring[bytes_compared..bytes_compared + len], 0) {
+                (Ordering::Equal, _) => bytes_compared += len,
+                (ordering, prefix_len) => return Ok((ordering, bytes_compared + prefix_len)),
+            }
+        }
+
+        Ok((compared_len.cmp(&substring.len()), compared_len))
+    }
+
+    fn samples_count(
+        &self,
+    ) -> usize {
+        self.chunk.samples_count()
+    }
+
+    fn samples_rate(
+        &self,
+    ) -> usize {
+        self.chunk.samples_rate
+    }
+
+    fn sample_key(
+        &self,
+        sample_index: usize,
+    ) -> io::Result<u64> {
+        let mut key = [0; 8];
+        self.block_cache.read_at(&mut key, self.chunk.sample_keys().offset + sample_index * 8)?;
+
+        Ok(LittleEndian::read_u64(&key))
+    }
+
+    fn sample_rank(
+        &self,
+        sample_index: usize,
+    ) -> io::Result<usize> {
+        Ok(self.read_u32(self.chunk.sample_ranks().offset + sample_index * 4)? as usize)
+    }
+
+    fn has_qgrams(
+        &self,
+    ) -> bool {
+        self.chunk.qgrams.len != 0
+    }
+
+    fn qgram_bound(
+        &self,
+        qgram: usize,
+    ) -> io::Result<usize> {
+        Ok(self.read_u32(self.chunk.qgrams.offset + qgram * 4)? as usize)
+    }
+
+    fn has_lcp_bounds(
+        &self,
+    ) -> bool {
+        self.chunk.lcp_bounds.len != 0
+    }
+
+    fn line_tail(
+        &self,
+        data_index: usize,
+    ) -> io::Result<usize> {
+        let text = &self.chunk.text;
+
+        let mut position = text.offset + data_index;
+        while position > text.offset {
+            let block_offset = (position - 1) / CACHE_BLOCK_LEN * CACHE_BLOCK_LEN;
+            let block = self.block_cache.text_block(block_offset / CACHE_BLOCK_LEN)?;
+            let block_start = block_offset.max(text.offset);
+            if let Some(previous_nl_pos) = memchr::memrchr(b'\n', &block[block_start - block_offset..position - block_offset]) {
+                return Ok(block_start + previous_nl_pos + 1 - text.offset);
+            }
+            position = block_start;
+        }
+
+        Ok(0)
+    }
+
+    fn newlines_count(
+        &self,
+        start: usize,
+        end: usize,
+    ) -> io::Result<usize> {
+        let text = &self.chunk.text;
+
+        let mut newlines_count = 0;
+        let mut position = text.offset + start;
+        let end = text.offset + end;
+        while position < end {
+            let block_offset = position / CACHE_BLOCK_LEN * CACHE_BLOCK_LEN;
+            let block = self.block_cache.text_block(position / CACHE_BLOCK_LEN)?;
+            let block_end = (block_offset + block.len()).min(end);
+            newlines_count += memchr::memchr_iter(b'\n', &block[position - block_offset..block_end - block_offset]).count();
+            position = block_end;
+        }
+
+        Ok(newlines_count)
+    }
+
+    fn has_line_ranks(
+        &self,
+    ) -> bool {
+        self.chunk.line_ranks.len != 0
+    }
+
+    fn line_rank(
+        &self,
+        text_block_index: usize,
+    ) -> io::Result<usize> {
+        Ok(self.read_u32(self.chunk.line_ranks.offset + text_block_index * 4)? as usize)
+    }
+
+    fn lcp_bounds(
+        &self,
+        suffix_index: usize,
+    ) -> io::Result<(usize, usize)> {
+        let mut lcp_bounds = [0; 2];
+        self.block_cache.read_at(&mut lcp_bounds, self.chunk.lcp_bounds.offset + suffix_index * 2)?;
+
+        let lcp_overflow = &self.chunk.lcp_overflow;
+        let lcp_bound = |position: usize, lcp: u8| match lcp {
+            LCP_ESCAPE => overflowed_lcp(
+                lcp_overflow.len / 8,
+                position,
+                |entry_index| {
+                    let mut entry = [0; 8];
+                    self.block_cache.read_at(&mut entry, lcp_overflow.offset + entry_index * 8)?;
+
+                    Ok(LittleEndian::read_u64(&entry))
+                },
+            ),
+            lcp => Ok(lcp as usize),
+        };
+
+        Ok((lcp_bound(suffix_index * 2, lcp_bounds[0])?, lcp_bound(suffix_index * 2 + 1, lcp_bounds[1])?))
+    }
+}
+
+/// Counts the occurrences of the substring in the chunk, which takes no more than the search for
+/// their range of the suffix array, or the distinct lines holding them, which also reads the text
+/// before every occurrence back to its line's start.
+fn count_chunk(
+    source: &impl ChunkSource,
+    substring: &[u8],
+    distinct_lines: bool,
+) -> io::Result<usize> {
+    let (start_of_indices, end_of_indices) = search_suffixes(source, substring)?;
+    if !distinct_lines {
+        return Ok(end_of_indices - start_of_indices);
+    }
+
+    let mut line_tails = AHashSet::with_capacity(end_of_indices - start_of_indices);
+    for suffix_index in start_of_indices..end_of_indices {
+        line_tails.insert(source.line_tail(source.suffix(suffix_index)?)?);
+    }
+
+    Ok(line_tails.len())
+}
+
+/// Where a line holding the substring is: its chunk, the ordinal of its entry in the whole index,
+/// its offset in the text of the chunk and the offsets of the occurrences within it.
+struct LinePosition {
+    chunk_id: usize,
+    entry: usize,
+    line_offset: usize,
+    match_offsets: Vec<usize>,
+}
+
+/// Finds the positions of the lines of the chunk holding the substring, in the order of the lines,
+/// with entry ordinals counted from the first line of the chunk. The ordinals start from the line
+/// rank sampled before every line, so no more than LINE_RANKS_INTERVAL bytes of text are read per
+/// line. Legacy chunks have no line ranks, so their text is counted from its start up to the last
+/// line found, or to its end when the number of lines of the chunk is asked for too.
+fn search_chunk_positions(
+    source: &impl ChunkSource,
+    substring: &[u8],
+    chunk_id: usize,
+    count_lines: bool,
+) -> io::Result<(Vec<LinePosition>, Option<usize>)> {
+    let (start_of_indices, end_of_indices) = search_suffixes(source, substring)?;
+
+    let mut occurrences = Vec::with_capacity(end_of_indices - start_of_indices);
+    for suffix_index in start_of_indices..end_of_indices {
+        let data_index = source.suffix(suffix_index)?;
+        let line_tail = source.line_tail(data_index)?;
+        occurrences.push((line_tail, data_index - line_tail));
+    }
+    occurrences.sort_unstable();
+
+    let mut positions: Vec<LinePosition> = Vec::new();
+    let mut entry = 0;
+    let mut counted_len = 0;
+    for (line_tail, match_offset) in occurrences {
+        match positions.last_mut() {
+            Some(position) if position.line_offset == line_tail => position.match_offsets.push(match_offset),
+            _ => {
+                let text_block_index = line_tail / LINE_RANKS_INTERVAL;
+                if source.has_line_ranks() && counted_len < text_block_index * LINE_RANKS_INTERVAL {
+                    entry = source.line_rank(text_block_index)?;
+                    counted_len = text_block_index * LINE_RANKS_INTERVAL;
+                }
+                entry += source.newlines_count(counted_len, line_tail)?;
+                counted_len = line_tail;
+                positions.push(
+                    LinePosition {
+                        chunk_id,
+                        entry,
+                        line_offset: line_tail,
+                        match_offsets: vec![match_offset],
+                    }
+                );
+            },
+        }
+    }
+
+    let lines_count = match count_lines {
+        true => Some(entry + source.newlines_count(counted_len, source.suffixes_count())?),
+        false => None,
+    };
+
+    Ok((positions, lines_count))
+}
+
+/// The number of lines a search may still return, shared by the searches of all its chunks so
+/// every one of them stops as soon as enough lines were collected, and the ones yet to start
+/// return without searching at all.
+struct LinesBudget {
+    remaining: AtomicUsize,
+}
+
+impl LinesBudget {
+    fn new(
+        limit: Option<usize>,
+    ) -> Self {
+        LinesBudget {
+            remaining: AtomicUsize::new(limit.unwrap_or(usize::MAX)),
+        }
+    }
+
+    fn remaining(
+        &self,
+    ) -> usize {
+        self.remaining.load(AtomicOrdering::Relaxed)
+    }
+
+    fn is_exhausted(
+        &self,
+    ) -> bool {
+        self.remaining() == 0
+    }
+
+    /// Takes one line out of the budget, or returns false once it is exhausted.
+    fn take(
+        &self,
+    ) -> bool {
+        self.remaining.fetch_update(
+            AtomicOrdering::Relaxed,
+            AtomicOrdering::Relaxed,
+            |remaining| remaining.checked_sub(1),
+        ).is_ok()
+    }
+}
+
+/// Where the visit of the lines of a chunk stopped, so that it can be resumed: the suffixes left
+/// to visit, once they are searched, and the lines visited already.
+#[derive(Default)]
+struct LinesCursor {
+    suffix_indices: Option<Range<usize>>,
+    matches_ranges: AHashSet<usize>,
+}
+
+impl LinesCursor {
+    fn is_exhausted(
+        &self,
+    ) -> bool {
+        self.suffix_indices.as_ref().is_some_and(|suffix_indices| suffix_indices.is_empty())
+    }
+}
+
+/// Reads every distinct line of the chunk holding the substring through the block cache and hands
+/// it to `on_line`, from where the cursor stopped until it returns false.
+fn visit_paged_chunk_lines(
+    block_cache: &BlockCache,
+    chunk: &ChunkInfo,
+    substring: &[u8],
+    lines_cursor: &mut LinesCursor,
+    mut on_line: impl FnMut(String) -> bool,
+) -> io::Result<()> {
+    let paged_chunk = PagedChunk {
+        block_cache,
+        chunk,
+    };
+    let mut suffix_indices = match lines_cursor.suffix_indices.take() {
+        Some(suffix_indices) => suffix_indices,
+        None => {
+            let (start_of_indices, end_of_indices) = search_suffixes(&paged_chunk, substring)?;
+            start_of_indices..end_of_indices
+        },
+    };
+
+    for suffix_index in suffix_indices.by_ref() {
+        let (line_tail, line_head) = paged_chunk.line_bounds(paged_chunk.suffix(suffix_index)?)?;
+        if lines_cursor.matches_ranges.insert(line_tail) {
+            let mut line = vec![0; line_head - line_tail];
+            block_cache.read_text_at(&mut line, chunk.text.offset + line_tail)?;
+            if !on_line(unsafe { String::from_utf8_unchecked(line) }) {
+                break;
+            }
+        }
+    }
+    lines_cursor.suffix_indices = Some(suffix_indices);
+
+    Ok(())
+}
+
+/// Hands every distinct line of the chunk holding the substring to `on_line`, from where the
+/// cursor stopped until it returns false.
+fn visit_chunk_lines<'a>(
+    memory_chunk: &MemoryChunk<'a>,
+    substring: &[u8],
+    lines_cursor: &mut LinesCursor,
+    mut on_line: impl FnMut(&'a str) -> bool,
+) -> io::Result<()> {
+    let mut suffix_indices = match lines_cursor.suffix_indices.take() {
+        Some(suffix_indices) => suffix_indices,
+        None => {
+            let (start_of_indices, end_of_indices) = search_suffixes(memory_chunk, substring)?;
+            start_of_indices..end_of_indices
+        },
+    };
+    let data = memory_chunk.data;
+
+    for suffix_index in suffix_indices.by_ref() {
+        let data_index = memory_chunk.suffixes[suffix_index * memory_chunk.suffixes_stride] as usize;
+        let line_tail = memory_chunk.line_tail(data_index)?;
+        if lines_cursor.matches_ranges.insert(line_tail) {
+            let line_head = match memchr::memchr(b'\n', &data[data_index..]) {
+                Some(next_nl_pos) => data_index + next_nl_pos,
+                None => data.len() - 1,
+            };
+            if !on_line(unsafe { str::from_utf8_unchecked(&data[line_tail..line_head]) }) {
+                break;
+            }
+        }
+    }
+    lines_cursor.suffix_indices = Some(suffix_indices);
+
+    Ok(())
+}
+
+fn search_paged_chunk(
+    block_cache: &BlockCache,
+    chunk: &ChunkInfo,
+    substring: &[u8],
+    lines_budget: &LinesBudget,
+) -> io::Result<Vec<String>> {
+    let mut results = Vec::new();
+    if !lines_budget.is_exhausted() {
+        visit_paged_chunk_lines(
+            block_cache,
+            chunk,
+            substring,
+            &mut LinesCursor::default(),
+            |line| lines_budget.take() && {
+                results.push(line);
+                true
+            },
+        )?;
+    }
+
+    Ok(results)
+}
+
+fn search_chunk<'a>(
+    memory_chunk: &MemoryChunk<'a>,
+    substring: &[u8],
+    lines_budget: &LinesBudget,
+) -> io::Result<Vec<&'a str>> {
+    let mut results = Vec::new();
+    if !lines_budget.is_exhausted() {
+        visit_chunk_lines(
+            memory_chunk,
+            substring,
+            &mut LinesCursor::default(),
+            |line| lines_budget.take() && {
+                results.push(line);
+                true
+            },
+        )?;
+    }
+
+    Ok(results)
+}
+
+/// The threads the lines of iter_search are searched on, apart from the rayon global pool the
+/// other searches run on, created with the first of them.
+fn lines_pool(
+) -> io::Result<&'static rayon::ThreadPool> {
+    static LINES_POOL: OnceLock<rayon::ThreadPool> = OnceLock::new();
+
+    if let Some(lines_pool) = LINES_POOL.get() {
+        return Ok(lines_pool);
+    }
+    let lines_pool = rayon::ThreadPoolBuilder::new()
+        .thread_name(|thread_index| format!("pysubstringsearch-lines-{}", thread_index))
+        .build()
+        .map_err(io::Error::other)?;
+
+    Ok(LINES_POOL.get_or_init(|| lines_pool))
+}
+
+/// A search whose lines are iterated, shared by the jobs searching it on the lines pool.
+struct LinesSearch {
+    chunks: Arc<Vec<ChunkInfo>>,
+    storage: Arc<ChunksStorage>,
+    substring: Vec<u8>,
+    next_chunk_id: AtomicUsize,
+}
+
+/// A chunk whose lines are being searched, and where its search stopped.
+struct LinesJob {
+    chunk_id: usize,
+    lines_cursor: LinesCursor,
+}
+
+/// A batch of lines, with the job to resume for the next one unless every chunk is searched.
+type LinesBatch = io::Result<(Vec<String>, Option<LinesJob>)>;
+
+impl LinesSearch {
+    /// Searches up to LINES_BATCH_LEN lines from where the job stopped, taking the next chunk
+    /// whenever one is exhausted, and returns without waiting for the batch to be consumed, so
+    /// no pool thread is held by an iterator that is not read from.
+    fn search_batch(
+        &self,
+        mut lines_job: Option<LinesJob>,
+    ) -> LinesBatch {
+        let mut lines = Vec::with_capacity(LINES_BATCH_LEN);
+        loop {
+            let mut job = match lines_job.take() {
+                Some(job) if !job.lines_cursor.is_exhausted() => job,
+                _ => {
+                    let chunk_id = self.next_chunk_id.fetch_add(1, AtomicOrdering::Relaxed);
+                    if chunk_id >= self.chunks.len() {
+                        return Ok((lines, None));
+                    }
+
+                    LinesJob {
+                        chunk_id,
+                        lines_cursor: LinesCursor::default(),
+                    }
+                },
+            };
+
+            let chunk = &self.chunks[job.chunk_id];
+            let lines_cursor = &mut job.lines_cursor;
+            let mut on_line = |line: String| {
+                lines.push(line);
+
+                lines.len() < LINES_BATCH_LEN
+            };
+            match &*self.storage {
+                ChunksStorage::Mapped { index_file, chunk_arrays } => {
+                    let memory_chunk = chunk_arrays[job.chunk_id].memory_chunk(index_file, chunk);
+                    visit_chunk_lines(&memory_chunk, &self.substring, lines_cursor, |line| on_line(line.to_string()))?;
+                },
+                ChunksStorage::Cached(chunk_cache) => match chunk_cache.get(job.chunk_id, chunk)? {
+                    Some(resident_chunk) => {
+                        visit_chunk_lines(&resident_chunk.memory_chunk(chunk), &self.substring, lines_cursor, |line| on_line(line.to_string()))?;
+                    },
+                    None => {
+                        visit_paged_chunk_lines(&chunk_cache.block_cache, chunk, &self.substring, lines_cursor, on_line)?;
+                    },
+                },
+                ChunksStorage::Paged(block_cache) => {
+                    visit_paged_chunk_lines(block_cache, chunk, &self.substring, lines_cursor, on_line)?;
+                },
+            }
+
+            if lines.len() == LINES_BATCH_LEN {
+                return Ok((lines, Some(job)));
+            }
+            lines_job = Some(job);
+        }
+    }
+}
+
+/// Searches the next batch of lines on the lines pool and sends it back to the iterator.
+fn spawn_lines_job(
+    lines_pool: &rayon::ThreadPool,
+    lines_search: Arc<LinesSearch>,
+    lines_job: Option<LinesJob>,
+    batches_sender: Sender<LinesBatch>,
+) {
+    lines_pool.spawn(
+        move || {
+            let _ = batches_sender.send(lines_search.search_batch(lines_job));
+        }
+    );
+}
+
+enum ChunksStorage {
+    Mapped {
+        index_file: IndexFile,
+        chunk_arrays: Vec<ChunkArrays>,
+    },
+    Cached(ChunkCache),
+    Paged(BlockCache),
+}
+
+#[pyclass]
+struct Reader {
+    chunks: Arc<Vec<ChunkInfo>>,
+    storage: Arc<ChunksStorage>,
+}
+
+#[pymethods]
+impl Reader {
     #[new]
     fn new(
+        py: Python,
         index_file_path: &str,
+        in_memory: Option<bool>,
+        max_resident_bytes: Option<usize>,
+        block_cache_bytes: Option<usize>,
     ) -> PyResult<Self> {
+        let in_memory = in_memory.unwrap_or(false);
+        if [in_memory, max_resident_bytes.is_some(), block_cache_bytes.is_some()].iter().filter(|&&mode| mode).count() > 1 {
+            return Err(
+                exceptions::PyValueError::new_err(
+                    "in_memory, max_resident_bytes and block_cache_bytes are mutually exclusive"
+                )
+            );
+        }
+
         let index_file = File::open(index_file_path)?;
-        let mut index_file = BufReader::new(index_file);
-        let index_file_metadata = std::fs::metadata(index_file_path)?;
-        let index_file_len = index_file_metadata.len();
-        let mut bytes_read = 0;
+        let chunks = if is_versioned_index_file(&index_file)? {
+            read_chunks_table(&index_file)?
+        } else {
+            read_legacy_chunks(&unsafe { Mmap::map(&index_file)? })?
+        };
 
-        let mut sub_indexes = Vec::new();
+        let storage = if let Some(max_resident_bytes) = max_resident_bytes {
+            ChunksStorage::Cached(ChunkCache::new(index_file, chunks.len(), max_resident_bytes)?)
+        } else if let Some(block_cache_bytes) = block_cache_bytes {
+            ChunksStorage::Paged(BlockCache::new(index_file, block_cache_bytes)?)
+        } else {
+            let index_file = if in_memory {
+                py.allow_threads(|| IndexFile::load(&index_file))?
+            } else {
+                IndexFile::Mapped(unsafe { Mmap::map(&index_file)? })
+            };
+            let chunk_arrays = chunks.iter().map(|chunk| ChunkArrays::new(&index_file, chunk)).collect();
 
-        while bytes_read < index_file_len {
-            let data_file_len = index_file.read_u32::<LittleEndian>()?;
-            let mut data = vec![0; data_file_len as usize];
-            index_file.read_exact(&mut data)?;
+            ChunksStorage::Mapped {
+                index_file,
+                chunk_arrays,
+            }
+        };
 
-            let suffixes_file_len = index_file.read_u32::<LittleEndian>()? as usize;
-            let suffixes_file_start = index_file.seek(SeekFrom::Current(0))? as usize;
-            let suffixes_file_end = suffixes_file_start + suffixes_file_len;
-            index_file.seek(SeekFrom::Current(suffixes_file_len as i64))?;
+        Ok(
+            Reader {
+                chunks: Arc::new(chunks),
+                storage: Arc::new(storage),
+            }
+        )
+    }
 
-            bytes_read += 4 + 4 + data_file_len as u64 + suffixes_file_len as u64;
+    fn search(
+        &self,
+        py: Python,
+        substring: &str,
+        limit: Option<usize>,
+    ) -> PyResult<Vec<PyObject>> {
+        let results = py.allow_threads(|| self.search_chunks(substring.as_bytes(), &LinesBudget::new(limit)))?;
 
-            sub_indexes.push(
-                SubIndex {
-                    data,
-                    index_file: BufReader::new(File::open(index_file_path)?),
-                    suffixes_file_start,
-                    suffixes_file_end,
-                    finder: memmem::Finder::new(b"\n"),
-                    finder_rev: memmem::FinderRev::new(b"\n"),
-                }
-            );
+        Ok(results.iter().map(|line| line.to_object(py)).collect())
+    }
+
+    fn search_multiple(
+        &self,
+        py: Python,
+        substrings: Vec<&str>,
+    ) -> PyResult<Vec<Vec<PyObject>>> {
+        let results = py.allow_threads(
+            || {
+                substrings.par_iter().map(
+                    |substring| self.search_chunks(substring.as_bytes(), &LinesBudget::new(None))
+                ).collect::<io::Result<Vec<_>>>()
+            }
+        )?;
+
+        Ok(
+            results.iter().map(
+                |substring_results| substring_results.iter().map(|line| line.to_object(py)).collect()
+            ).collect()
+        )
+    }
+
+    /// Starts a search whose lines are iterated as the chunks are searched in the background,
+    /// instead of being collected first. One batch per thread of the lines pool is searched
+    /// ahead of the iteration at most.
+    fn iter_search(
+        &self,
+        substring: &str,
+    ) -> PyResult<LinesIterator> {
+        let lines_pool = lines_pool()?;
+        let lines_search = Arc::new(
+            LinesSearch {
+                chunks: self.chunks.clone(),
+                storage: self.storage.clone(),
+                substring: substring.as_bytes().to_vec(),
+                next_chunk_id: AtomicUsize::new(0),
+            }
+        );
+        let (batches_sender, batches_receiver) = mpsc::channel();
+        let pending_jobs = lines_pool.current_num_threads().min(self.chunks.len());
+        for _ in 0..pending_jobs {
+            spawn_lines_job(lines_pool, lines_search.clone(), None, batches_sender.clone());
         }
 
-        Ok(Reader { sub_indexes })
+        Ok(
+            LinesIterator {
+                lines_search,
+                batches_sender,
+                batches_receiver: Mutex::new(batches_receiver),
+                pending_jobs,
+                lines: Vec::new().into_iter(),
+            }
+        )
+    }
+
+    /// Searches like search, but returns a ResultSet that keeps the lines in the buffers they
+    /// were found in rather than building a str for each of them.
+    fn search_lazy(
+        &self,
+        py: Python,
+        substring: &str,
+        limit: Option<usize>,
+    ) -> PyResult<ResultSet> {
+        Ok(py.allow_threads(|| self.search_chunks_spans(substring.as_bytes(), &LinesBudget::new(limit)))?)
     }
 
-    fn search(
-        &mut self,
+    /// Returns a (chunk id, entry ordinal, line offset, match offsets) tuple for every line
+    /// holding the substring. The offsets are in bytes, the line offset within the text of its
+    /// chunk and the match offsets within the line.
+    fn search_positions(
+        &self,
+        py: Python,
         substring: &str,
-    ) -> PyResult<Vec<&str>> {
-        let results = Arc::new(Mutex::new(Vec::new()));
-
-        self.sub_indexes.par_iter_mut().for_each(
-            |sub_index| {
-                let mut start_of_indices = None;
-                let mut end_of_indices = None;
-
-                let mut left_anchor = sub_index.suffixes_file_start;
-                let mut right_anchor = sub_index.suffixes_file_end - 4;
-                while left_anchor <= right_anchor {
-                    let middle_anchor = left_anchor + ((right_anchor - left_anchor) / 4 / 2 * 4);
-                    sub_index.index_file.seek(SeekFrom::Start(middle_anchor as u64)).unwrap();
-                    let data_index = sub_index.index_file.read_i32::<LittleEndian>().unwrap();
-
-                    let line = &sub_index.data[data_index as usize..];
-                    if line.starts_with(substring.as_bytes()) {
-                        start_of_indices = Some(middle_anchor);
-                        right_anchor = middle_anchor - 4;
-                    } else {
-                        match substring.as_bytes().cmp(line) {
-                            std::cmp::Ordering::Less => right_anchor = middle_anchor - 4,
-                            std::cmp::Ordering::Greater => left_anchor = middle_anchor + 4,
-                            std::cmp::Ordering::Equal => {},
-                        };
+    ) -> PyResult<Vec<PyObject>> {
+        let positions = py.allow_threads(|| self.search_chunks_positions(substring.as_bytes()))?;
+
+        Ok(
+            positions.iter().map(
+                |position| (position.chunk_id, position.entry, position.line_offset, &position.match_offsets).to_object(py)
+            ).collect()
+        )
+    }
+
+    fn count_occurrences(
+        &self,
+        py: Python,
+        substring: &str,
+    ) -> PyResult<usize> {
+        Ok(py.allow_threads(|| self.count_chunks(substring.as_bytes(), false))?)
+    }
+
+    fn count_lines(
+        &self,
+        py: Python,
+        substring: &str,
+    ) -> PyResult<usize> {
+        Ok(py.allow_threads(|| self.count_chunks(substring.as_bytes(), true))?)
+    }
+
+    fn count_multiple(
+        &self,
+        py: Python,
+        substrings: Vec<&str>,
+    ) -> PyResult<Vec<usize>> {
+        let counts = py.allow_threads(
+            || {
+                substrings.par_iter().map(
+                    |substring| self.count_chunks(substring.as_bytes(), false)
+                ).collect::<io::Result<Vec<_>>>()
+            }
+        )?;
+
+        Ok(counts)
+    }
+}
+
+impl Reader {
+    /// Searches all the chunks concurrently, collecting no more lines than the budget allows. Lines
+    /// of resident chunks are copied out rather than borrowed from the chunk the cache hands out,
+    /// and lines read through a block cache are owned to begin with.
+    fn search_chunks(
+        &self,
+        substring: &[u8],
+        lines_budget: &LinesBudget,
+    ) -> io::Result<Vec<Cow<'_, str>>> {
+        match &*self.storage {
+            ChunksStorage::Mapped { index_file, chunk_arrays } => {
+                let results = self.chunks.par_iter().zip(chunk_arrays).map(
+                    |(chunk, chunk_arrays)| search_chunk(&chunk_arrays.memory_chunk(index_file, chunk), substring, lines_budget)
+                ).collect::<io::Result<Vec<_>>>()?;
+
+                Ok(results.into_iter().flatten().map(Cow::Borrowed).collect())
+            },
+            ChunksStorage::Cached(chunk_cache) => {
+                let results = self.chunks.par_iter().enumerate().map(
+                    |(chunk_id, chunk)| {
+                        if lines_budget.is_exhausted() {
+                            return Ok(Vec::new());
+                        }
+                        match chunk_cache.get(chunk_id, chunk)? {
+                            Some(resident_chunk) => {
+                                let lines = search_chunk(&resident_chunk.memory_chunk(chunk), substring, lines_budget)?;
+
+                                Ok(lines.into_iter().map(|line| Cow::Owned(line.to_string())).collect::<Vec<_>>())
+                            },
+                            None => {
+                                let lines = search_paged_chunk(&chunk_cache.block_cache, chunk, substring, lines_budget)?;
+
+                                Ok(lines.into_iter().map(Cow::Owned).collect())
+                            },
+                        }
                     }
-                }
-                if start_of_indices.is_none() {
-                    return;
-                }
+                ).collect::<io::Result<Vec<_>>>()?;
+
+                Ok(results.into_iter().flatten().collect())
+            },
+            ChunksStorage::Paged(block_cache) => {
+                let results = self.chunks.par_iter().map(
+                    |chunk| search_paged_chunk(block_cache, chunk, substring, lines_budget)
+                ).collect::<io::Result<Vec<_>>>()?;
+
+                Ok(results.into_iter().flatten().map(Cow::Owned).collect())
+            },
+        }
+    }
+
+    /// Searches all the chunks concurrently like search_chunks, but keeps the lines where they
+    /// already are and returns their spans. Lines of a mapped index point into the index itself.
+    /// Lines of a resident chunk are copied into one buffer per chunk rather than pinning the
+    /// chunk, whose suffix array and tables would stay alive outside the cache budget for as long
+    /// as the ResultSet does, and lines read through a block cache are read into one such buffer.
+    fn search_chunks_spans(
+        &self,
+        substring: &[u8],
+        lines_budget: &LinesBudget,
+    ) -> io::Result<ResultSet> {
+        let results = match &*self.storage {
+            ChunksStorage::Mapped { index_file, chunk_arrays } => {
+                self.chunks.par_iter().zip(chunk_arrays).map(
+                    |(chunk, chunk_arrays)| {
+                        let lines = search_chunk(&chunk_arrays.memory_chunk(index_file, chunk), substring, lines_budget)?;
+                        let spans = lines.into_iter().map(|line| line_span(index_file, line)).collect();
+
+                        Ok((LinesBuffer::Index(self.storage.clone()), spans))
+                    }
+                ).collect::<io::Result<Vec<_>>>()?
+            },
+            ChunksStorage::Cached(chunk_cache) => {
+                self.chunks.par_iter().enumerate().map(
+                    |(chunk_id, chunk)| {
+                        if lines_budget.is_exhausted() {
+                            return Ok((LinesBuffer::Read(Vec::new()), Vec::new()));
+                        }
+                        match chunk_cache.get(chunk_id, chunk)? {
+                            Some(resident_chunk) => {
+                                let lines = search_chunk(&resident_chunk.memory_chunk(chunk), substring, lines_budget)?;
+                                let mut buffer = Vec::with_capacity(lines.iter().map(|line| line.len()).sum());
+                                let spans = lines.into_iter().map(
+                                    |line| {
+                                        buffer.extend_from_slice(line.as_bytes());
+
+                                        (buffer.len() - line.len(), buffer.len())
+                                    }
+                                ).collect();
+
+                                Ok((LinesBuffer::Read(buffer), spans))
+                            },
+                            None => read_paged_chunk_lines(&chunk_cache.block_cache, chunk, substring, lines_budget),
+                        }
+                    }
+                ).collect::<io::Result<Vec<_>>>()?
+            },
+            ChunksStorage::Paged(block_cache) => {
+                self.chunks.par_iter().map(
+                    |chunk| read_paged_chunk_lines(block_cache, chunk, substring, lines_budget)
+                ).collect::<io::Result<Vec<_>>>()?
+            },
+        };
+
+        let mut result_set = ResultSet {
+            buffers: Vec::new(),
+            lines: Vec::new(),
+        };
+        for (buffer, spans) in results {
+            if spans.is_empty() {
+                continue;
+            }
+            let buffer_index = result_set.buffers.len();
+            result_set.buffers.push(Arc::new(buffer));
+            result_set.lines.extend(
+                spans.into_iter().map(|(start, end)| LineSpan { buffer_index, start, end })
+            );
+        }
+
+        Ok(result_set)
+    }
+
+    /// Finds the positions of the lines holding the substring in all the chunks concurrently, in
+    /// the order of the entries. Chunks of legacy index files do not record their number of lines,
+    /// so their whole text is read to number the entries of the chunks after them.
+    fn search_chunks_positions(
+        &self,
+        substring: &[u8],
+    ) -> io::Result<Vec<LinePosition>> {
+        let results = match &*self.storage {
+            ChunksStorage::Mapped { index_file, chunk_arrays } => {
+                self.chunks.par_iter().zip(chunk_arrays).enumerate().map(
+                    |(chunk_id, (chunk, chunk_arrays))| {
+                        search_chunk_positions(&chunk_arrays.memory_chunk(index_file, chunk), substring, chunk_id, chunk.entries.is_none())
+                    }
+                ).collect::<io::Result<Vec<_>>>()?
+            },
+            ChunksStorage::Cached(chunk_cache) => {
+                self.chunks.par_iter().enumerate().map(
+                    |(chunk_id, chunk)| match chunk_cache.get(chunk_id, chunk)? {
+                        Some(resident_chunk) => {
+                            search_chunk_positions(&resident_chunk.memory_chunk(chunk), substring, chunk_id, chunk.entries.is_none())
+                        },
+                        None => {
+                            let paged_chunk = PagedChunk {
+                                block_cache: &chunk_cache.block_cache,
+                                chunk,
+                            };
 
-                let mut right_anchor = sub_index.suffixes_file_end - 4;
-                while left_anchor <= right_anchor {
-                    let middle_anchor = left_anchor + ((right_anchor - left_anchor) / 4 / 2 * 4);
-                    sub_index.index_file.seek(SeekFrom::Start(middle_anchor as u64)).unwrap();
-                    let data_index = sub_index.index_file.read_i32::<LittleEndian>().unwrap();
-
-                    let line = &sub_index.data[data_index as usize..];
-                    if line.starts_with(substring.as_bytes()) {
-                        end_of_indices = Some(middle_anchor);
-                        left_anchor = middle_anchor + 4;
-                    } else {
-                        match substring.as_bytes().cmp(line) {
-                            std::cmp::Ordering::Less => right_anchor = middle_anchor - 4,
-                            std::cmp::Ordering::Greater => left_anchor = middle_anchor + 4,
-                            std::cmp::Ordering::Equal => {},
+                            search_chunk_positions(&paged_chunk, substring, chunk_id, chunk.entries.is_none())
+                        },
+                    }
+                ).collect::<io::Result<Vec<_>>>()?
+            },
+            ChunksStorage::Paged(block_cache) => {
+                self.chunks.par_iter().enumerate().map(
+                    |(chunk_id, chunk)| {
+                        let paged_chunk = PagedChunk {
+                            block_cache,
+                            chunk,
                         };
+
+                        search_chunk_positions(&paged_chunk, substring, chunk_id, chunk.entries.is_none())
                     }
-                }
+                ).collect::<io::Result<Vec<_>>>()?
+            },
+        };
 
-                let start_of_indices = start_of_indices.unwrap();
-                let end_of_indices = end_of_indices.unwrap();
-
-                let mut suffixes = vec![0; end_of_indices - start_of_indices + 4];
-
-                sub_index.index_file.seek(SeekFrom::Start(start_of_indices as u64)).unwrap();
-                sub_index.index_file.read_exact(&mut suffixes).unwrap();
-
-                let mut matches_ranges = AHashSet::new();
-                let mut local_results = Vec::with_capacity((end_of_indices - start_of_indices + 4) / 4);
-                for suffix in suffixes.chunks_mut(4) {
-                    let data_index = LittleEndian::read_i32(suffix);
-                    let line_head = match sub_index.finder.find(&sub_index.data[data_index as usize..]) {
-                        Some(next_nl_pos) => data_index as usize + next_nl_pos,
-                        None => sub_index.data.len() - 1,
-                    };
-                    let line_tail = match sub_index.finder_rev.rfind(&sub_index.data[..data_index as usize]) {
-                        Some(previous_nl_pos) => previous_nl_pos + 1,
-                        None => 0,
-                    };
-                    if matches_ranges.insert(line_tail) {
-                        let line = unsafe { str::from_utf8_unchecked(&sub_index.data[line_tail..line_head]) };
-                        local_results.push(line);
+        let mut positions = Vec::new();
+        let mut first_entry = 0;
+        for (chunk, (chunk_positions, lines_count)) in self.chunks.iter().zip(results) {
+            positions.extend(
+                chunk_positions.into_iter().map(
+                    |position| LinePosition {
+                        entry: first_entry + position.entry,
+                        ..position
                     }
-                }
+                )
+            );
+            first_entry += chunk.entries.or(lines_count).unwrap_or_default();
+        }
+
+        Ok(positions)
+    }
+
+    /// Counts the occurrences of the substring in all the chunks concurrently, or the distinct
+    /// lines holding them. Neither the lines nor any Python object are built.
+    fn count_chunks(
+        &self,
+        substring: &[u8],
+        distinct_lines: bool,
+    ) -> io::Result<usize> {
+        match &*self.storage {
+            ChunksStorage::Mapped { index_file, chunk_arrays } => {
+                self.chunks.par_iter().zip(chunk_arrays).map(
+                    |(chunk, chunk_arrays)| count_chunk(&chunk_arrays.memory_chunk(index_file, chunk), substring, distinct_lines)
+                ).sum()
+            },
+            ChunksStorage::Cached(chunk_cache) => {
+                self.chunks.par_iter().enumerate().map(
+                    |(chunk_id, chunk)| match chunk_cache.get(chunk_id, chunk)? {
+                        Some(resident_chunk) => count_chunk(&resident_chunk.memory_chunk(chunk), substring, distinct_lines),
+                        None => {
+                            let paged_chunk = PagedChunk {
+                                block_cache: &chunk_cache.block_cache,
+                                chunk,
+                            };
+
+                            count_chunk(&paged_chunk, substring, distinct_lines)
+                        },
+                    }
+                ).sum()
+            },
+            ChunksStorage::Paged(block_cache) => {
+                self.chunks.par_iter().map(
+                    |chunk| {
+                        let paged_chunk = PagedChunk {
+                            block_cache,
+                            chunk,
+                        };
+
+                        count_chunk(&paged_chunk, substring, distinct_lines)
+                    }
+                ).sum()
+            },
+        }
+    }
+}
 
-                results.lock().extend(local_results);
+/// Reads the lines of the chunk holding the substring through the block cache into one buffer,
+/// returned with the spans of the lines in it.
+fn read_paged_chunk_lines(
+    block_cache: &BlockCache,
+    chunk: &ChunkInfo,
+    substring: &[u8],
+    lines_budget: &LinesBudget,
+) -> io::Result<(LinesBuffer, Vec<(usize, usize)>)> {
+    let mut buffer = Vec::new();
+    let mut spans = Vec::new();
+    if !lines_budget.is_exhausted() {
+        visit_paged_chunk_lines(
+            block_cache,
+            chunk,
+            substring,
+            &mut LinesCursor::default(),
+            |line| lines_budget.take() && {
+                spans.push((buffer.len(), buffer.len() + line.len()));
+                buffer.extend_from_slice(line.as_bytes());
+                true
+            },
+        )?;
+    }
+
+    Ok((LinesBuffer::Read(buffer), spans))
+}
+
+/// Returns the start and end offsets of a line borrowed from the buffer.
+fn line_span(
+    buffer: &[u8],
+    line: &str,
+) -> (usize, usize) {
+    let start = line.as_ptr() as usize - buffer.as_ptr() as usize;
+
+    (start, start + line.len())
+}
+
+/// The bytes the lines of a ResultSet point into.
+enum LinesBuffer {
+    Index(Arc<ChunksStorage>),
+    Read(Vec<u8>),
+}
+
+impl std::ops::Deref for LinesBuffer {
+    type Target = [u8];
+
+    fn deref(
+        &self,
+    ) -> &[u8] {
+        match self {
+            LinesBuffer::Index(storage) => match &**storage {
+                ChunksStorage::Mapped { index_file, .. } => index_file,
+                _ => unreachable!("only a mapped index holds the lines of its chunks"),
+            },
+            LinesBuffer::Read(lines) => lines,
+        }
+    }
+}
+
+struct LineSpan {
+    buffer_index: usize,
+    start: usize,
+    end: usize,
+}
+
+/// The lines found by a search, kept as spans into the buffers they were found in. A line becomes
+/// a str only when it is indexed, and can be taken as bytes or as a memoryview of the buffer
+/// itself instead.
+#[pyclass]
+struct ResultSet {
+    buffers: Vec<Arc<LinesBuffer>>,
+    lines: Vec<LineSpan>,
+}
+
+impl ResultSet {
+    fn line_span(
+        &self,
+        index: isize,
+    ) -> PyResult<&LineSpan> {
+        let index = if index < 0 { index + self.lines.len() as isize } else { index };
+
+        usize::try_from(index).ok().and_then(|index| self.lines.get(index)).ok_or_else(
+            || exceptions::PyIndexError::new_err("result index out of range")
+        )
+    }
+
+    fn line_bytes(
+        &self,
+        line_span: &LineSpan,
+    ) -> &[u8] {
+        &self.buffers[line_span.buffer_index][line_span.start..line_span.end]
+    }
+}
+
+#[pymethods]
+impl ResultSet {
+    fn __len__(
+        &self,
+    ) -> usize {
+        self.lines.len()
+    }
+
+    fn __getitem__(
+        &self,
+        py: Python,
+        index: isize,
+    ) -> PyResult<PyObject> {
+        let line = self.line_bytes(self.line_span(index)?);
+
+        Ok(unsafe { str::from_utf8_unchecked(line) }.to_object(py))
+    }
+
+    fn bytes(
+        &self,
+        py: Python,
+        index: isize,
+    ) -> PyResult<PyObject> {
+        let line = self.line_bytes(self.line_span(index)?);
+
+        Ok(PyBytes::new(py, line).to_object(py))
+    }
+
+    fn memoryview(
+        &self,
+        py: Python,
+        index: isize,
+    ) -> PyResult<PyObject> {
+        let line_span = self.line_span(index)?;
+        let line_buffer = Py::new(
+            py,
+            LineBuffer {
+                buffer: self.buffers[line_span.buffer_index].clone(),
+                start: line_span.start,
+                end: line_span.end,
+            },
+        )?;
+
+        unsafe { PyObject::from_owned_ptr_or_err(py, ffi::PyMemoryView_FromObject(line_buffer.as_ptr())) }
+    }
+}
+
+/// Exports a single line of a ResultSet through the buffer protocol, keeping its buffer alive for
+/// as long as any memoryview of it is.
+#[pyclass]
+struct LineBuffer {
+    buffer: Arc<LinesBuffer>,
+    start: usize,
+    end: usize,
+}
+
+#[pymethods]
+impl LineBuffer {
+    unsafe fn __getbuffer__(
+        slf: &PyCell<Self>,
+        view: *mut ffi::Py_buffer,
+        flags: c_int,
+    ) -> PyResult<()> {
+        let line_buffer = slf.borrow();
+        let line = &line_buffer.buffer[line_buffer.start..line_buffer.end];
+        if ffi::PyBuffer_FillInfo(view, slf.as_ptr(), line.as_ptr() as *mut c_void, line.len() as ffi::Py_ssize_t, 1, flags) == -1 {
+            return Err(PyErr::fetch(slf.py()));
+        }
+
+        Ok(())
+    }
+}
+
+/// The lines of a search running in the background, received in batches as they are found. The
+/// job of every batch received is resumed for the next one, so the search stops once the
+/// iterator is dropped.
+#[pyclass]
+struct LinesIterator {
+    lines_search: Arc<LinesSearch>,
+    batches_sender: Sender<LinesBatch>,
+    batches_receiver: Mutex<Receiver<LinesBatch>>,
+    pending_jobs: usize,
+    lines: std::vec::IntoIter<String>,
+}
+
+#[pymethods]
+impl LinesIterator {
+    fn __iter__(
+        slf: PyRef<Self>,
+    ) -> PyRef<Self> {
+        slf
+    }
+
+    fn __next__(
+        &mut self,
+        py: Python,
+    ) -> PyResult<Option<PyObject>> {
+        loop {
+            if let Some(line) = self.lines.next() {
+                return Ok(Some(line.to_object(py)));
             }
-        );
 
-        let results = results.lock().to_vec();
+            if self.pending_jobs == 0 {
+                return Ok(None);
+            }
+            let batches_receiver = &self.batches_receiver;
+            let lines_batch = match py.allow_threads(|| batches_receiver.lock().recv()) {
+                Ok(lines_batch) => lines_batch,
+                Err(_) => return Ok(None),
+            };
+            self.pending_jobs -= 1;
 
-        Ok(results)
+            let (lines, lines_job) = lines_batch?;
+            if let Some(lines_job) = lines_job {
+                spawn_lines_job(lines_pool()?, self.lines_search.clone(), Some(lines_job), self.batches_sender.clone());
+                self.pending_jobs += 1;
+            }
+            self.lines = lines.into_iter();
+        }
     }
 }
 
@@ -294,6 +3648,9 @@ fn pysubstringsearch(
 ) -> PyResult<()> {
     m.add_class::<Writer>()?;
     m.add_class::<Reader>()?;
+    m.add_class::<LinesIterator>()?;
+    m.add_class::<ResultSet>()?;
+    m.add_class::<LineBuffer>()?;
 
     Ok(())
 }
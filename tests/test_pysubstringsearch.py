@@ -1,4 +1,6 @@
+import concurrent.futures
 import os
+import struct
 import tempfile
 import unittest
 
@@ -13,35 +15,43 @@ class PySubstringSearchTestCase(
         strings,
         substring,
         expected_results,
+        writer_options=None,
+        reader_options=None,
     ):
         try:
             with tempfile.TemporaryDirectory() as tmp_directory:
                 index_file_path = f'{tmp_directory}/output.idx'
-                writer = pysubstringsearch.Writer(
-                    index_file_path=index_file_path,
-                )
-                for string in strings:
-                    writer.add_entry(
-                        text=string,
+                for writer_kwargs in writer_options or [{}]:
+                    writer = pysubstringsearch.Writer(
+                        index_file_path=index_file_path,
+                        **writer_kwargs,
                     )
-                writer.finalize()
+                    for string in strings:
+                        writer.add_entry(
+                            text=string,
+                        )
+                    writer.finalize()
 
-                reader = pysubstringsearch.Reader(
-                    index_file_path=index_file_path,
-                )
-                self.assertCountEqual(
-                    first=reader.search(
-                        substring=substring,
-                    ),
-                    second=expected_results,
-                )
+                    for reader_kwargs in reader_options or [{}]:
+                        reader = pysubstringsearch.Reader(
+                            index_file_path=index_file_path,
+                            **reader_kwargs,
+                        )
+                        # the second search runs on whatever the first one left cached
+                        for _ in range(2):
+                            self.assertCountEqual(
+                                first=reader.search(
+                                    substring=substring,
+                                ),
+                                second=expected_results,
+                            )
 
-                try:
-                    os.unlink(
-                        path=index_file_path,
-                    )
-                except Exception:
-                    pass
+                    try:
+                        os.unlink(
+                            path=index_file_path,
+                        )
+                    except Exception:
+                        pass
         except PermissionError:
             pass
 
@@ -292,3 +302,981 @@ class PySubstringSearchTestCase(
                     pass
         except PermissionError:
             pass
+
+    def test_multiple_strings_grouped(
+        self,
+    ):
+        try:
+            with tempfile.TemporaryDirectory() as tmp_directory:
+                index_file_path = f'{tmp_directory}/output.idx'
+                writer = pysubstringsearch.Writer(
+                    index_file_path=index_file_path,
+                )
+                for string in [
+                    'one',
+                    'two',
+                    'three',
+                    'seven',
+                    'eleven',
+                ]:
+                    writer.add_entry(
+                        text=string,
+                    )
+                writer.finalize()
+
+                reader = pysubstringsearch.Reader(
+                    index_file_path=index_file_path,
+                )
+                results = reader.search_multiple_grouped(
+                    substrings=[
+                        'ven',
+                        'ee',
+                        'missing',
+                        'o',
+                    ],
+                )
+                self.assertEqual(
+                    first=len(results),
+                    second=4,
+                )
+                self.assertCountEqual(
+                    first=results[0],
+                    second=[
+                        'seven',
+                        'eleven',
+                    ],
+                )
+                self.assertEqual(
+                    first=results[1],
+                    second=[
+                        'three',
+                    ],
+                )
+                self.assertEqual(
+                    first=results[2],
+                    second=[],
+                )
+                self.assertCountEqual(
+                    first=results[3],
+                    second=[
+                        'one',
+                        'two',
+                    ],
+                )
+
+                try:
+                    os.unlink(
+                        path=index_file_path,
+                    )
+                except Exception:
+                    pass
+        except PermissionError:
+            pass
+
+    def test_max_chunk_len_limit(
+        self,
+    ):
+        with tempfile.TemporaryDirectory() as tmp_directory:
+            with self.assertRaises(
+                expected_exception=ValueError,
+            ):
+                pysubstringsearch.Writer(
+                    index_file_path=f'{tmp_directory}/output.idx',
+                    max_chunk_len=2 ** 31,
+                )
+
+    def test_concurrent_searches(
+        self,
+    ):
+        try:
+            with tempfile.TemporaryDirectory() as tmp_directory:
+                index_file_path = f'{tmp_directory}/output.idx'
+                writer = pysubstringsearch.Writer(
+                    index_file_path=index_file_path,
+                    max_chunk_len=64,
+                )
+                for i in range(1000):
+                    writer.add_entry(
+                        text=f'entry number {i}',
+                    )
+                writer.finalize()
+
+                reader = pysubstringsearch.Reader(
+                    index_file_path=index_file_path,
+                )
+                with concurrent.futures.ThreadPoolExecutor(
+                    max_workers=8,
+                ) as executor:
+                    futures = [
+                        executor.submit(
+                            reader.search,
+                            substring=f'number {i}',
+                        )
+                        for i in range(100)
+                    ]
+
+                    for i, future in enumerate(futures):
+                        self.assertCountEqual(
+                            first=future.result(),
+                            second=[
+                                f'entry number {j}'
+                                for j in range(1000)
+                                if f'entry number {j}'.startswith(f'entry number {i}')
+                            ],
+                        )
+
+                try:
+                    os.unlink(
+                        path=index_file_path,
+                    )
+                except Exception:
+                    pass
+        except PermissionError:
+            pass
+
+    def test_multithreaded_writer(
+        self,
+    ):
+        try:
+            with tempfile.TemporaryDirectory() as tmp_directory:
+                index_file_path = f'{tmp_directory}/output.idx'
+                writer = pysubstringsearch.Writer(
+                    index_file_path=index_file_path,
+                    max_chunk_len=4096,
+                    threads=0,
+                    concurrent_chunks=4,
+                )
+                for i in range(10000):
+                    writer.add_entry(
+                        text=f'entry number {i}',
+                    )
+                writer.finalize()
+
+                reader = pysubstringsearch.Reader(
+                    index_file_path=index_file_path,
+                )
+                self.assertCountEqual(
+                    first=reader.search(
+                        substring='number 999',
+                    ),
+                    second=[
+                        'entry number 999',
+                        'entry number 9990',
+                        'entry number 9991',
+                        'entry number 9992',
+                        'entry number 9993',
+                        'entry number 9994',
+                        'entry number 9995',
+                        'entry number 9996',
+                        'entry number 9997',
+                        'entry number 9998',
+                        'entry number 9999',
+                    ],
+                )
+
+                try:
+                    os.unlink(
+                        path=index_file_path,
+                    )
+                except Exception:
+                    pass
+        except PermissionError:
+            pass
+
+    def test_finalize_twice(
+        self,
+    ):
+        try:
+            with tempfile.TemporaryDirectory() as tmp_directory:
+                index_file_path = f'{tmp_directory}/output.idx'
+                writer = pysubstringsearch.Writer(
+                    index_file_path=index_file_path,
+                )
+                writer.add_entry(
+                    text='first entry',
+                )
+                writer.finalize()
+                writer.add_entry(
+                    text='second entry',
+                )
+                writer.finalize()
+
+                reader = pysubstringsearch.Reader(
+                    index_file_path=index_file_path,
+                )
+                self.assertCountEqual(
+                    first=reader.search(
+                        substring='entry',
+                    ),
+                    second=[
+                        'first entry',
+                        'second entry',
+                    ],
+                )
+
+                try:
+                    os.unlink(
+                        path=index_file_path,
+                    )
+                except Exception:
+                    pass
+        except PermissionError:
+            pass
+
+    def test_in_memory_reader(
+        self,
+    ):
+        self.assert_substring_search(
+            strings=[
+                f'entry number {i}'
+                for i in range(1000)
+            ],
+            substring='number 99',
+            expected_results=[
+                'entry number 99',
+            ] + [
+                f'entry number 99{i}'
+                for i in range(10)
+            ],
+            writer_options=[
+                {'max_chunk_len': 4096},
+            ],
+            reader_options=[
+                {'in_memory': True},
+            ],
+        )
+
+    def test_bounded_memory_reader(
+        self,
+    ):
+        self.assert_substring_search(
+            strings=[
+                f'entry number {i}'
+                for i in range(1000)
+            ],
+            substring='number 99',
+            expected_results=[
+                'entry number 99',
+            ] + [
+                f'entry number 99{i}'
+                for i in range(10)
+            ],
+            writer_options=[
+                {'max_chunk_len': 4096},
+            ],
+            reader_options=[
+                {'max_resident_bytes': 0},
+                {'max_resident_bytes': 8192},
+                {'max_resident_bytes': 1024 * 1024},
+            ],
+        )
+
+        with self.assertRaises(
+            expected_exception=ValueError,
+        ):
+            pysubstringsearch.Reader(
+                index_file_path='missing_index_file_path',
+                in_memory=True,
+                max_resident_bytes=8192,
+            )
+
+    def test_block_cache_reader(
+        self,
+    ):
+        self.assert_substring_search(
+            strings=[
+                f'entry number {i}'
+                for i in range(1000)
+            ],
+            substring='number 99',
+            expected_results=[
+                'entry number 99',
+            ] + [
+                f'entry number 99{i}'
+                for i in range(10)
+            ],
+            writer_options=[
+                {'max_chunk_len': 4096},
+            ],
+            reader_options=[
+                {'block_cache_bytes': 0},
+                {'block_cache_bytes': 8192},
+                {'block_cache_bytes': 1024 * 1024},
+            ],
+        )
+
+        with self.assertRaises(
+            expected_exception=ValueError,
+        ):
+            pysubstringsearch.Reader(
+                index_file_path='missing_index_file_path',
+                max_resident_bytes=8192,
+                block_cache_bytes=8192,
+            )
+
+    def test_shared_prefixes(
+        self,
+    ):
+        strings = [
+            f'prefix shared by every entry {i}'
+            for i in range(5000)
+        ]
+
+        self.assert_substring_search(
+            strings=strings,
+            substring='prefix shared by every entry 4999',
+            expected_results=[
+                'prefix shared by every entry 4999',
+            ],
+        )
+
+        self.assert_substring_search(
+            strings=strings,
+            substring='every entry 123',
+            expected_results=[
+                'prefix shared by every entry 123',
+            ] + [
+                f'prefix shared by every entry 123{i}'
+                for i in range(10)
+            ],
+        )
+
+        self.assert_substring_search(
+            strings=strings,
+            substring='prefix shared by every entry 5000',
+            expected_results=[],
+        )
+
+    def test_large_chunk(
+        self,
+    ):
+        strings = [
+            f'large chunk entry {i:06d}'
+            for i in range(100000)
+        ]
+
+        self.assert_substring_search(
+            strings=strings,
+            substring='entry 09999',
+            expected_results=[
+                f'large chunk entry 09999{i}'
+                for i in range(10)
+            ],
+        )
+
+        self.assert_substring_search(
+            strings=strings,
+            substring='y 099999',
+            expected_results=[
+                'large chunk entry 099999',
+            ],
+        )
+
+        self.assert_substring_search(
+            strings=strings,
+            substring='entry 1',
+            expected_results=[],
+        )
+
+    def test_inline_prefixes(
+        self,
+    ):
+        strings = [
+            f'entry number {i}'
+            for i in range(1000)
+        ]
+
+        self.assert_substring_search(
+            strings=strings,
+            substring='number 99',
+            expected_results=[
+                'entry number 99',
+            ] + [
+                f'entry number 99{i}'
+                for i in range(10)
+            ],
+            writer_options=[
+                {'max_chunk_len': 4096, 'inline_prefixes': True},
+            ],
+            reader_options=[
+                {},
+                {'block_cache_bytes': 8192},
+            ],
+        )
+
+        self.assert_substring_search(
+            strings=strings,
+            substring='ent',
+            expected_results=strings,
+            writer_options=[
+                {'max_chunk_len': 4096, 'inline_prefixes': True},
+            ],
+            reader_options=[
+                {},
+                {'block_cache_bytes': 8192},
+            ],
+        )
+
+    def test_lcp_bounds(
+        self,
+    ):
+        repeated_prefix = 'log line ' * 40
+        try:
+            with tempfile.TemporaryDirectory() as tmp_directory:
+                index_file_path = f'{tmp_directory}/output.idx'
+                for lcp_bounds in [False, True]:
+                    writer = pysubstringsearch.Writer(
+                        index_file_path=index_file_path,
+                        lcp_bounds=lcp_bounds,
+                    )
+                    for i in range(1000):
+                        writer.add_entry(
+                            text=f'{repeated_prefix}{i}',
+                        )
+                    writer.finalize()
+
+                    for reader_options in [{}, {'block_cache_bytes': 8192}]:
+                        reader = pysubstringsearch.Reader(
+                            index_file_path=index_file_path,
+                            **reader_options,
+                        )
+                        self.assertCountEqual(
+                            first=reader.search(
+                                substring=f'{repeated_prefix}99',
+                            ),
+                            second=[
+                                f'{repeated_prefix}99',
+                            ] + [
+                                f'{repeated_prefix}99{i}'
+                                for i in range(10)
+                            ],
+                        )
+                        self.assertCountEqual(
+                            first=reader.search(
+                                substring=f'line {repeated_prefix}',
+                            ),
+                            second=[],
+                        )
+                        self.assertEqual(
+                            first=len(
+                                reader.search(
+                                    substring=repeated_prefix[1:],
+                                ),
+                            ),
+                            second=1000,
+                        )
+
+                try:
+                    os.unlink(
+                        path=index_file_path,
+                    )
+                except Exception:
+                    pass
+        except PermissionError:
+            pass
+
+    def test_count(
+        self,
+    ):
+        try:
+            with tempfile.TemporaryDirectory() as tmp_directory:
+                index_file_path = f'{tmp_directory}/output.idx'
+                writer = pysubstringsearch.Writer(
+                    index_file_path=index_file_path,
+                    max_chunk_len=64,
+                )
+                for i in range(100):
+                    writer.add_entry(
+                        text=f'entry {i} entry',
+                    )
+                writer.finalize()
+
+                for block_cache_bytes in [None, 8192]:
+                    reader = pysubstringsearch.Reader(
+                        index_file_path=index_file_path,
+                        block_cache_bytes=block_cache_bytes,
+                    )
+                    self.assertEqual(
+                        first=reader.count_occurrences(
+                            substring='entry',
+                        ),
+                        second=200,
+                    )
+                    self.assertEqual(
+                        first=reader.count_lines(
+                            substring='entry',
+                        ),
+                        second=100,
+                    )
+                    self.assertEqual(
+                        first=reader.count_lines(
+                            substring='y 9',
+                        ),
+                        second=11,
+                    )
+                    self.assertEqual(
+                        first=reader.count_multiple(
+                            substrings=[
+                                'entry',
+                                ' 1',
+                                'missing',
+                            ],
+                        ),
+                        second=[
+                            200,
+                            11,
+                            0,
+                        ],
+                    )
+
+                try:
+                    os.unlink(
+                        path=index_file_path,
+                    )
+                except Exception:
+                    pass
+        except PermissionError:
+            pass
+
+    def test_search_limit(
+        self,
+    ):
+        try:
+            with tempfile.TemporaryDirectory() as tmp_directory:
+                index_file_path = f'{tmp_directory}/output.idx'
+                writer = pysubstringsearch.Writer(
+                    index_file_path=index_file_path,
+                    max_chunk_len=64,
+                )
+                for i in range(100):
+                    writer.add_entry(
+                        text=f'entry {i} entry',
+                    )
+                writer.finalize()
+
+                reader = pysubstringsearch.Reader(
+                    index_file_path=index_file_path,
+                )
+                for limit in [0, 1, 10, 100, 1000]:
+                    results = reader.search(
+                        substring='entry',
+                        limit=limit,
+                    )
+                    self.assertEqual(
+                        first=len(results),
+                        second=min(limit, 100),
+                    )
+                    self.assertEqual(
+                        first=len(set(results)),
+                        second=len(results),
+                    )
+
+                self.assertEqual(
+                    first=reader.search(
+                        substring='entry 42 ',
+                        limit=5,
+                    ),
+                    second=[
+                        'entry 42 entry',
+                    ],
+                )
+
+                try:
+                    os.unlink(
+                        path=index_file_path,
+                    )
+                except Exception:
+                    pass
+        except PermissionError:
+            pass
+
+    def test_iter_search(
+        self,
+    ):
+        try:
+            with tempfile.TemporaryDirectory() as tmp_directory:
+                index_file_path = f'{tmp_directory}/output.idx'
+                writer = pysubstringsearch.Writer(
+                    index_file_path=index_file_path,
+                    max_chunk_len=64,
+                )
+                for i in range(3000):
+                    writer.add_entry(
+                        text=f'entry {i} entry',
+                    )
+                writer.finalize()
+
+                reader = pysubstringsearch.Reader(
+                    index_file_path=index_file_path,
+                )
+                self.assertCountEqual(
+                    first=list(
+                        reader.iter_search(
+                            substring='entry',
+                        )
+                    ),
+                    second=reader.search(
+                        substring='entry',
+                    ),
+                )
+                self.assertEqual(
+                    first=list(
+                        reader.iter_search(
+                            substring='entry 42 ',
+                        )
+                    ),
+                    second=[
+                        'entry 42 entry',
+                    ],
+                )
+                self.assertEqual(
+                    first=list(
+                        reader.iter_search(
+                            substring='missing',
+                        )
+                    ),
+                    second=[],
+                )
+
+                lines_iterator = reader.iter_search(
+                    substring='entry',
+                )
+                self.assertTrue(
+                    expr=next(lines_iterator).startswith('entry '),
+                )
+                del lines_iterator
+
+                lines_iterators = [
+                    reader.iter_search(
+                        substring='entry',
+                    )
+                    for _ in range(64)
+                ]
+                for lines_iterator in lines_iterators:
+                    next(lines_iterator)
+                for lines_iterator in reversed(lines_iterators):
+                    self.assertEqual(
+                        first=len(list(lines_iterator)),
+                        second=2999,
+                    )
+                del lines_iterators
+
+                try:
+                    os.unlink(
+                        path=index_file_path,
+                    )
+                except Exception:
+                    pass
+        except PermissionError:
+            pass
+
+    def test_search_lazy(
+        self,
+    ):
+        try:
+            with tempfile.TemporaryDirectory() as tmp_directory:
+                index_file_path = f'{tmp_directory}/output.idx'
+                writer = pysubstringsearch.Writer(
+                    index_file_path=index_file_path,
+                    max_chunk_len=64,
+                )
+                for i in range(100):
+                    writer.add_entry(
+                        text=f'entry {i} entry',
+                    )
+                writer.finalize()
+
+                for reader_options in [{}, {'max_resident_bytes': 8192}, {'block_cache_bytes': 8192}]:
+                    reader = pysubstringsearch.Reader(
+                        index_file_path=index_file_path,
+                        **reader_options,
+                    )
+                    result_set = reader.search_lazy(
+                        substring='entry',
+                    )
+                    self.assertEqual(
+                        first=len(result_set),
+                        second=100,
+                    )
+                    self.assertCountEqual(
+                        first=list(result_set),
+                        second=reader.search(
+                            substring='entry',
+                        ),
+                    )
+
+                    result_set = reader.search_lazy(
+                        substring='entry 42 ',
+                    )
+                    self.assertEqual(
+                        first=list(result_set),
+                        second=[
+                            'entry 42 entry',
+                        ],
+                    )
+                    self.assertEqual(
+                        first=result_set.bytes(0),
+                        second=b'entry 42 entry',
+                    )
+                    self.assertEqual(
+                        first=result_set.memoryview(-1).tobytes(),
+                        second=b'entry 42 entry',
+                    )
+                    with self.assertRaises(
+                        expected_exception=IndexError,
+                    ):
+                        result_set[1]
+
+                    self.assertEqual(
+                        first=len(
+                            reader.search_lazy(
+                                substring='entry',
+                                limit=10,
+                            )
+                        ),
+                        second=10,
+                    )
+
+                try:
+                    os.unlink(
+                        path=index_file_path,
+                    )
+                except Exception:
+                    pass
+        except PermissionError:
+            pass
+
+    def test_search_positions(
+        self,
+    ):
+        try:
+            with tempfile.TemporaryDirectory() as tmp_directory:
+                index_file_path = f'{tmp_directory}/output.idx'
+                writer = pysubstringsearch.Writer(
+                    index_file_path=index_file_path,
+                    max_chunk_len=64,
+                )
+                entries = [
+                    f'entry {i} entry'
+                    for i in range(100)
+                ]
+                for entry in entries:
+                    writer.add_entry(
+                        text=entry,
+                    )
+                writer.finalize()
+
+                for reader_options in [{}, {'max_resident_bytes': 8192}, {'block_cache_bytes': 8192}]:
+                    reader = pysubstringsearch.Reader(
+                        index_file_path=index_file_path,
+                        **reader_options,
+                    )
+                    positions = reader.search_positions(
+                        substring='entry',
+                    )
+                    self.assertEqual(
+                        first=[
+                            entry_ordinal
+                            for _, entry_ordinal, _, _ in positions
+                        ],
+                        second=list(range(100)),
+                    )
+                    for _, entry_ordinal, _, match_offsets in positions:
+                        self.assertEqual(
+                            first=match_offsets,
+                            second=[
+                                0,
+                                len(entries[entry_ordinal]) - len('entry'),
+                            ],
+                        )
+                    for previous_position, position in zip(positions, positions[1:]):
+                        previous_chunk_id, previous_entry_ordinal, previous_line_offset, _ = previous_position
+                        chunk_id, entry_ordinal, line_offset, _ = position
+                        if chunk_id == previous_chunk_id:
+                            self.assertEqual(
+                                first=line_offset,
+                                second=previous_line_offset + len(entries[previous_entry_ordinal]) + 1,
+                            )
+                        else:
+                            self.assertEqual(
+                                first=line_offset,
+                                second=0,
+                            )
+
+                    positions = reader.search_positions(
+                        substring='y 42 e',
+                    )
+                    self.assertEqual(
+                        first=len(positions),
+                        second=1,
+                    )
+                    _, entry_ordinal, _, match_offsets = positions[0]
+                    self.assertEqual(
+                        first=entry_ordinal,
+                        second=42,
+                    )
+                    self.assertEqual(
+                        first=match_offsets,
+                        second=[
+                            4,
+                        ],
+                    )
+
+                    self.assertEqual(
+                        first=reader.search_positions(
+                            substring='missing',
+                        ),
+                        second=[],
+                    )
+
+                try:
+                    os.unlink(
+                        path=index_file_path,
+                    )
+                except Exception:
+                    pass
+
+                writer = pysubstringsearch.Writer(
+                    index_file_path=index_file_path,
+                    max_chunk_len=64,
+                )
+                lines = []
+                for i in range(50):
+                    entry = f'first {i}\nsecond {i}' if i % 10 == 3 else f'single {i}'
+                    writer.add_entry(
+                        text=entry,
+                    )
+                    lines.extend(entry.split('\n'))
+                writer.finalize()
+
+                for reader_options in [{}, {'block_cache_bytes': 8192}]:
+                    reader = pysubstringsearch.Reader(
+                        index_file_path=index_file_path,
+                        **reader_options,
+                    )
+                    positions = reader.search_positions(
+                        substring=' ',
+                    )
+                    self.assertEqual(
+                        first=len({chunk_id for chunk_id, _, _, _ in positions}) > 1,
+                        second=True,
+                    )
+                    self.assertEqual(
+                        first=[
+                            entry_ordinal
+                            for _, entry_ordinal, _, _ in positions
+                        ],
+                        second=list(range(len(lines))),
+                    )
+                    for line in ['second 43', 'single 49']:
+                        self.assertEqual(
+                            first=[
+                                entry_ordinal
+                                for _, entry_ordinal, _, _ in reader.search_positions(
+                                    substring=line,
+                                )
+                            ],
+                            second=[
+                                lines.index(line),
+                            ],
+                        )
+
+                try:
+                    os.unlink(
+                        path=index_file_path,
+                    )
+                except Exception:
+                    pass
+        except PermissionError:
+            pass
+
+    def test_legacy_index_file(
+        self,
+    ):
+        try:
+            with tempfile.TemporaryDirectory() as tmp_directory:
+                index_file_path = f'{tmp_directory}/output.idx'
+                entries = [
+                    f'legacy entry {i}'
+                    for i in range(25)
+                ]
+                with open(index_file_path, 'wb') as index_file:
+                    for chunk_entries in [entries[:10], entries[10:]]:
+                        text = ''.join(
+                            f'{entry}\n'
+                            for entry in chunk_entries
+                        ).encode()
+                        suffixes = sorted(
+                            range(len(text)),
+                            key=lambda suffix: text[suffix:],
+                        )
+                        index_file.write(struct.pack('<I', len(text)))
+                        index_file.write(text)
+                        index_file.write(struct.pack('<I', len(suffixes) * 4))
+                        index_file.write(struct.pack(f'<{len(suffixes)}i', *suffixes))
+                self.assertNotEqual(
+                    first=len(''.join(f'{entry}\n' for entry in entries[:10])) % 4,
+                    second=0,
+                )
+
+                for reader_options in [
+                    {},
+                    {'in_memory': True},
+                    {'max_resident_bytes': 8192},
+                    {'max_resident_bytes': 256},
+                    {'block_cache_bytes': 8192},
+                ]:
+                    reader = pysubstringsearch.Reader(
+                        index_file_path=index_file_path,
+                        **reader_options,
+                    )
+                    self.assertCountEqual(
+                        first=reader.search(
+                            substring='entry 1',
+                        ),
+                        second=[
+                            entry
+                            for entry in entries
+                            if 'entry 1' in entry
+                        ],
+                    )
+                    self.assertEqual(
+                        first=reader.count_occurrences(
+                            substring='legacy',
+                        ),
+                        second=25,
+                    )
+
+                    positions = reader.search_positions(
+                        substring='legacy',
+                    )
+                    self.assertEqual(
+                        first=[
+                            (chunk_id, entry_ordinal)
+                            for chunk_id, entry_ordinal, _, _ in positions
+                        ],
+                        second=[
+                            (0 if i < 10 else 1, i)
+                            for i in range(25)
+                        ],
+                    )
+                    self.assertEqual(
+                        first=[
+                            entry_ordinal
+                            for _, entry_ordinal, _, _ in reader.search_positions(
+                                substring='entry 17',
+                            )
+                        ],
+                        second=[
+                            17,
+                        ],
+                    )
+
+                try:
+                    os.unlink(
+                        path=index_file_path,
+                    )
+                except Exception:
+                    pass
+        except PermissionError:
+            pass